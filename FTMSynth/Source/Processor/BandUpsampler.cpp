@@ -0,0 +1,103 @@
+/*
+  ==============================================================================
+
+    BandUpsampler.cpp
+    Created: 17 Oct 2026 11:45:39am
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "BandUpsampler.h"
+
+#include <cmath>
+
+
+// zeroth-order modified Bessel function, for the Kaiser window
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+
+//==================================
+void BandUpsampler::computeFilter()
+{
+    // ~80 dB of image rejection above 1 - passbandEdge
+    const double beta = 8.0;
+    double sum = 0.0;
+
+    for (int j = 0; j < 2*halfLength; j++)
+    {
+        // distance (in input samples) from the output point, halfway between two inputs
+        double d = j - halfLength + 0.5;
+        double r = d / halfLength;
+        double window = besselI0(beta * sqrt(1.0 - r*r)) / besselI0(beta);
+        taps[j] = sin(M_PI * d) / (M_PI * d) * window;
+        sum += taps[j];
+    }
+
+    // unity gain at DC
+    for (int j = 0; j < 2*halfLength; j++)
+        taps[j] /= sum;
+}
+
+void BandUpsampler::reserve(int maxNumSamples)
+{
+    // upsample() of n samples from a level needs at most (n+1)/2 + 2*halfLength - 1 of them, and
+    // produces at most (n+1)/2 + halfLength new ones, which is what it asks from the level below
+    int numSamples = maxNumSamples;
+    for (int b = 1; b < maxBands; b++)
+    {
+        size_t size = size_t((numSamples + 1) / 2 + 2*halfLength - 1);
+        if (levels[b].samples.size() < size)
+            levels[b].samples.resize(size);
+        numSamples = (numSamples + 1) / 2 + halfLength;
+    }
+}
+
+void BandUpsampler::reset(int newNumBands)
+{
+    numBands = newNumBands;
+    outputPosition = 0;
+
+    for (int b = 1; b < numBands; b++)
+    {
+        Level& level = levels[b];
+        if (level.samples.size() < size_t(halfLength - 1))
+            level.samples.resize(halfLength - 1);
+        std::fill(level.samples.begin(), level.samples.begin() + (halfLength - 1), 0.0);
+        level.size = halfLength - 1;
+        level.next = halfLength - 1;
+        level.odd = false;
+        level.produced = 0;
+    }
+}
+
+int64_t BandUpsampler::getLead(int band) const
+{
+    return (levels[band].produced << band) - outputPosition;
+}
@@ -0,0 +1,1048 @@
+/*
+  ==============================================================================
+
+    ModeBank.cpp
+    Created: 17 Oct 2026 11:17:07am
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "ModeBank.h"
+
+#include <algorithm>
+#include <JuceHeader.h>
+
+#if FTM_MODEBANK_X86
+ #include <immintrin.h>
+ #if defined(__GNUC__) || defined(__clang__)
+  #define FTM_TARGET_AVX2 __attribute__((target("avx2")))
+ #else
+  #define FTM_TARGET_AVX2
+ #endif
+#endif
+
+// Number of accumulator lanes per output sample in the scratch buffers
+static constexpr int numLanes = 4;
+static constexpr int numFloatLanes = 8;
+
+
+//==================================
+// Plain per-mode loop, also used for the modes left over by the vectorised kernels.
+// With ramp, the increments change by incrementSteps + incrementStepFractions / 2^32 every sample
+template <bool ramp>
+static void renderScalar(const double* sinTable, int sinTableShift,
+                         uint32_t* phases, const uint32_t* increments,
+                         const int32_t* incrementSteps, const uint32_t* incrementStepFractions,
+                         const double* gains, const double* decays, double* envStates,
+                         size_t begin, size_t end, double* output, int numSamples)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        uint32_t phase = phases[i];
+        uint32_t inc = increments[i];
+        uint32_t step = (ramp ? uint32_t(incrementSteps[i]) : 0);
+        uint32_t stepFraction = (ramp ? incrementStepFractions[i] : 0);
+        uint32_t fraction = ModeBank::initialStepFraction;
+        double gain = gains[i];
+        double decay = decays[i];
+        double amp = envStates[i];
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            output[s] += gain * amp * sinTable[phase >> sinTableShift];
+            phase += inc;
+            if constexpr (ramp)
+            {
+                fraction += stepFraction;
+                inc += step + (fraction < stepFraction ? 1 : 0);  // carry
+            }
+            amp *= decay;
+        }
+
+        phases[i] = phase;
+        envStates[i] = amp;
+    }
+}
+
+//==================================
+// Same as renderScalar() with the phasor recursion instead of the table
+static void renderPhasorsScalar(double* re, double* im, const double* rotorRe, const double* rotorIm,
+                                const double* gains, size_t begin, size_t end,
+                                double* output, int numSamples)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        double zr = re[i];
+        double zi = im[i];
+        double rr = rotorRe[i];
+        double ri = rotorIm[i];
+        double gain = gains[i];
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            output[s] += gain * zi;
+
+            double nextRe = zr*rr - zi*ri;
+            zi = zr*ri + zi*rr;
+            zr = nextRe;
+        }
+
+        re[i] = zr;
+        im[i] = zi;
+    }
+}
+
+//==================================
+// Single-precision version of renderScalar()
+static void renderFloatScalar(const float* sinTable, int sinTableShift,
+                              uint32_t* phases, const uint32_t* increments,
+                              const float* gains, const float* decays, float* envStates,
+                              size_t begin, size_t end, float* output, int numSamples)
+{
+    for (size_t i = begin; i < end; i++)
+    {
+        uint32_t phase = phases[i];
+        uint32_t inc = increments[i];
+        float gain = gains[i];
+        float decay = decays[i];
+        float amp = envStates[i];
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            output[s] += gain * amp * sinTable[phase >> sinTableShift];
+            phase += inc;
+            amp *= decay;
+        }
+
+        phases[i] = phase;
+        envStates[i] = amp;
+    }
+}
+
+//==================================
+// Small table with linear interpolation on the phase bits below the table index
+static void renderInterpolatedScalar(const float* table, int tableBits,
+                                     uint32_t* phases, const uint32_t* increments,
+                                     const double* gains, const double* decays, double* envStates,
+                                     size_t begin, size_t end, double* output, int numSamples)
+{
+    const int shift = 32 - tableBits;
+    const uint32_t fracMask = (1u << shift) - 1;
+    const double fracScale = 1.0 / double(1u << shift);
+
+    for (size_t i = begin; i < end; i++)
+    {
+        uint32_t phase = phases[i];
+        uint32_t inc = increments[i];
+        double gain = gains[i];
+        double decay = decays[i];
+        double amp = envStates[i];
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            uint32_t index = phase >> shift;
+            double frac = (phase & fracMask) * fracScale;
+            double a = table[index];
+            double value = a + frac * (table[index + 1] - a);
+
+            output[s] += gain * amp * value;
+            phase += inc;
+            amp *= decay;
+        }
+
+        phases[i] = phase;
+        envStates[i] = amp;
+    }
+}
+
+//==================================
+// One mode at a time, envelopes evaluated as envChunk * decay^k over chunks of envelopeChunk
+// samples so that the samples of a chunk do not depend on each other
+static void renderBlockExponentialScalar(const double* sinTable, int sinTableShift,
+                                         uint32_t* phases, const uint32_t* increments,
+                                         const double* gains, const double* decays,
+                                         const double* decayPowers, const double* chunkDecays,
+                                         double* envStates, size_t begin, size_t end,
+                                         double* output, int numSamples)
+{
+    const int chunk = ModeBank::envelopeChunk;
+    const int numChunkSamples = numSamples - numSamples % chunk;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        // muted modes are skipped, so their phase and envelope don't advance. The other kernels
+        // do render them and only freeze them when the voice also zeroes inc and sets decay = 1
+        if (gains[i] == 0.0) continue;
+
+        uint32_t phase = phases[i];
+        uint32_t inc = increments[i];
+        double gain = gains[i];
+        double amp = envStates[i];
+        const double* powers = decayPowers + i*chunk;
+
+        int s = 0;
+        for (; s < numChunkSamples; s += chunk)
+        {
+            for (int k = 0; k < chunk; k++)
+                output[s + k] += gain * (amp * powers[k]) * sinTable[uint32_t(phase + k*inc) >> sinTableShift];
+
+            phase += chunk*inc;
+            amp *= chunkDecays[i];
+        }
+        for (; s < numSamples; s++)
+        {
+            output[s] += gain * amp * sinTable[phase >> sinTableShift];
+            phase += inc;
+            amp *= decays[i];
+        }
+
+        phases[i] = phase;
+        envStates[i] = amp;
+    }
+}
+
+#if FTM_MODEBANK_X86
+//==================================
+// 4 modes in lockstep, table reads are done lane by lane (no gather in SSE2)
+// returns the number of modes rendered, starting at begin
+template <bool ramp>
+static size_t renderSSE2(const double* sinTable, int sinTableShift,
+                         uint32_t* phases, const uint32_t* increments,
+                         const int32_t* incrementSteps, const uint32_t* incrementStepFractions,
+                         const double* gains, const double* decays, double* envStates,
+                         size_t begin, size_t end, double* scratch, int numSamples)
+{
+    const __m128i shift = _mm_cvtsi32_si128(sinTableShift);
+    const __m128i signBit = _mm_set1_epi32(int(0x80000000));
+    alignas(16) uint32_t index[4];
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128i phase = _mm_loadu_si128(reinterpret_cast<const __m128i*>(phases + i));
+        __m128i inc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(increments + i));
+        // the fractions are kept xor signBit, so that a signed compare detects their carries
+        __m128i step = _mm_setzero_si128(), stepFraction = _mm_setzero_si128(), stepFractionBiased = signBit;
+        if constexpr (ramp)
+        {
+            step = _mm_loadu_si128(reinterpret_cast<const __m128i*>(incrementSteps + i));
+            stepFraction = _mm_loadu_si128(reinterpret_cast<const __m128i*>(incrementStepFractions + i));
+            stepFractionBiased = _mm_xor_si128(stepFraction, signBit);
+        }
+        __m128i fractionBiased = _mm_xor_si128(_mm_set1_epi32(int(ModeBank::initialStepFraction)), signBit);
+
+        __m128d gain0 = _mm_loadu_pd(gains + i);
+        __m128d gain1 = _mm_loadu_pd(gains + i + 2);
+        __m128d decay0 = _mm_loadu_pd(decays + i);
+        __m128d decay1 = _mm_loadu_pd(decays + i + 2);
+        __m128d amp0 = _mm_loadu_pd(envStates + i);
+        __m128d amp1 = _mm_loadu_pd(envStates + i + 2);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_srl_epi32(phase, shift));
+            __m128d value0 = _mm_set_pd(sinTable[index[1]], sinTable[index[0]]);
+            __m128d value1 = _mm_set_pd(sinTable[index[3]], sinTable[index[2]]);
+
+            __m128d y = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(gain0, amp0), value0),
+                                   _mm_mul_pd(_mm_mul_pd(gain1, amp1), value1));
+
+            double* acc = scratch + s*numLanes;
+            _mm_storeu_pd(acc, _mm_add_pd(_mm_loadu_pd(acc), y));
+
+            phase = _mm_add_epi32(phase, inc);
+            if constexpr (ramp)
+            {
+                fractionBiased = _mm_add_epi32(fractionBiased, stepFraction);
+                __m128i carry = _mm_cmplt_epi32(fractionBiased, stepFractionBiased);  // -1 where it wrapped
+                inc = _mm_sub_epi32(_mm_add_epi32(inc, step), carry);
+            }
+            amp0 = _mm_mul_pd(amp0, decay0);
+            amp1 = _mm_mul_pd(amp1, decay1);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(phases + i), phase);
+        _mm_storeu_pd(envStates + i, amp0);
+        _mm_storeu_pd(envStates + i + 2, amp1);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// 8 modes in lockstep, table reads use hardware gathers
+// returns the number of modes rendered, starting at begin
+template <bool ramp>
+FTM_TARGET_AVX2
+static size_t renderAVX2(const double* sinTable, int sinTableShift,
+                         uint32_t* phases, const uint32_t* increments,
+                         const int32_t* incrementSteps, const uint32_t* incrementStepFractions,
+                         const double* gains, const double* decays, double* envStates,
+                         size_t begin, size_t end, double* scratch, int numSamples)
+{
+    const __m128i shift = _mm_cvtsi32_si128(sinTableShift);
+    const __m256i signBit = _mm256_set1_epi32(int(0x80000000));
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256i phase = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(phases + i));
+        __m256i inc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(increments + i));
+        __m256i step = _mm256_setzero_si256(), stepFraction = _mm256_setzero_si256(), stepFractionBiased = signBit;
+        if constexpr (ramp)
+        {
+            step = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(incrementSteps + i));
+            stepFraction = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(incrementStepFractions + i));
+            stepFractionBiased = _mm256_xor_si256(stepFraction, signBit);
+        }
+        __m256i fractionBiased = _mm256_xor_si256(_mm256_set1_epi32(int(ModeBank::initialStepFraction)), signBit);
+
+        __m256d gain0 = _mm256_loadu_pd(gains + i);
+        __m256d gain1 = _mm256_loadu_pd(gains + i + 4);
+        __m256d decay0 = _mm256_loadu_pd(decays + i);
+        __m256d decay1 = _mm256_loadu_pd(decays + i + 4);
+        __m256d amp0 = _mm256_loadu_pd(envStates + i);
+        __m256d amp1 = _mm256_loadu_pd(envStates + i + 4);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            __m256i index = _mm256_srl_epi32(phase, shift);
+            __m256d value0 = _mm256_i32gather_pd(sinTable, _mm256_castsi256_si128(index), 8);
+            __m256d value1 = _mm256_i32gather_pd(sinTable, _mm256_extracti128_si256(index, 1), 8);
+
+            __m256d y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(gain0, amp0), value0),
+                                      _mm256_mul_pd(_mm256_mul_pd(gain1, amp1), value1));
+
+            double* acc = scratch + s*numLanes;
+            _mm256_storeu_pd(acc, _mm256_add_pd(_mm256_loadu_pd(acc), y));
+
+            phase = _mm256_add_epi32(phase, inc);
+            if constexpr (ramp)
+            {
+                fractionBiased = _mm256_add_epi32(fractionBiased, stepFraction);
+                __m256i carry = _mm256_cmpgt_epi32(stepFractionBiased, fractionBiased);
+                inc = _mm256_sub_epi32(_mm256_add_epi32(inc, step), carry);
+            }
+            amp0 = _mm256_mul_pd(amp0, decay0);
+            amp1 = _mm256_mul_pd(amp1, decay1);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(phases + i), phase);
+        _mm256_storeu_pd(envStates + i, amp0);
+        _mm256_storeu_pd(envStates + i + 4, amp1);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// Time-axis kernel: the 8 samples of a chunk of one mode are computed as two 4-lane vectors
+FTM_TARGET_AVX2
+static void renderBlockExponentialAVX2(const double* sinTable, int sinTableShift,
+                                       uint32_t* phases, const uint32_t* increments,
+                                       const double* gains, const double* decays,
+                                       const double* decayPowers, const double* chunkDecays,
+                                       double* envStates, size_t begin, size_t end,
+                                       double* output, int numSamples)
+{
+    static_assert(ModeBank::envelopeChunk == 8, "the AVX2 kernel handles chunks of 8 samples");
+
+    const int chunk = ModeBank::envelopeChunk;
+    const int numChunkSamples = numSamples - numSamples % chunk;
+    const __m128i shift = _mm_cvtsi32_si128(sinTableShift);
+    const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    for (size_t i = begin; i < end; i++)
+    {
+        // muted modes are skipped, so their phase and envelope don't advance. The other kernels
+        // do render them and only freeze them when the voice also zeroes inc and sets decay = 1
+        if (gains[i] == 0.0) continue;
+
+        uint32_t inc = increments[i];
+        double amp = envStates[i];
+
+        __m256i phase = _mm256_add_epi32(_mm256_set1_epi32(int(phases[i])),
+                                         _mm256_mullo_epi32(steps, _mm256_set1_epi32(int(inc))));
+        __m256i chunkInc = _mm256_set1_epi32(int(chunk*inc));
+
+        __m256d gain = _mm256_set1_pd(gains[i]);
+        __m256d powers0 = _mm256_loadu_pd(decayPowers + i*chunk);
+        __m256d powers1 = _mm256_loadu_pd(decayPowers + i*chunk + 4);
+
+        int s = 0;
+        for (; s < numChunkSamples; s += chunk)
+        {
+            __m256i index = _mm256_srl_epi32(phase, shift);
+            __m256d value0 = _mm256_i32gather_pd(sinTable, _mm256_castsi256_si128(index), 8);
+            __m256d value1 = _mm256_i32gather_pd(sinTable, _mm256_extracti128_si256(index, 1), 8);
+
+            __m256d env = _mm256_set1_pd(amp);
+            __m256d y0 = _mm256_mul_pd(_mm256_mul_pd(gain, _mm256_mul_pd(env, powers0)), value0);
+            __m256d y1 = _mm256_mul_pd(_mm256_mul_pd(gain, _mm256_mul_pd(env, powers1)), value1);
+
+            _mm256_storeu_pd(output + s,     _mm256_add_pd(_mm256_loadu_pd(output + s), y0));
+            _mm256_storeu_pd(output + s + 4, _mm256_add_pd(_mm256_loadu_pd(output + s + 4), y1));
+
+            phase = _mm256_add_epi32(phase, chunkInc);
+            amp *= chunkDecays[i];
+        }
+
+        uint32_t scalarPhase = uint32_t(_mm256_cvtsi256_si32(phase));
+        for (; s < numSamples; s++)
+        {
+            output[s] += gains[i] * amp * sinTable[scalarPhase >> sinTableShift];
+            scalarPhase += inc;
+            amp *= decays[i];
+        }
+
+        phases[i] = scalarPhase;
+        envStates[i] = amp;
+    }
+}
+
+//==================================
+// 4 interpolated modes in lockstep
+static size_t renderInterpolatedSSE2(const float* table, int tableBits,
+                                     uint32_t* phases, const uint32_t* increments,
+                                     const double* gains, const double* decays, double* envStates,
+                                     size_t begin, size_t end, double* scratch, int numSamples)
+{
+    const __m128i shift = _mm_cvtsi32_si128(32 - tableBits);
+    const __m128i fracMask = _mm_set1_epi32(int((1u << (32 - tableBits)) - 1));
+    const __m128d fracScale = _mm_set1_pd(1.0 / double(1u << (32 - tableBits)));
+    alignas(16) uint32_t index[4];
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128i phase = _mm_loadu_si128(reinterpret_cast<const __m128i*>(phases + i));
+        __m128i inc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(increments + i));
+
+        __m128d gain0 = _mm_loadu_pd(gains + i),      gain1 = _mm_loadu_pd(gains + i + 2);
+        __m128d decay0 = _mm_loadu_pd(decays + i),    decay1 = _mm_loadu_pd(decays + i + 2);
+        __m128d amp0 = _mm_loadu_pd(envStates + i),   amp1 = _mm_loadu_pd(envStates + i + 2);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_srl_epi32(phase, shift));
+
+            // the fractional bits are < 2^31, so the signed conversion is exact
+            __m128i fracBits = _mm_and_si128(phase, fracMask);
+            __m128d frac0 = _mm_mul_pd(_mm_cvtepi32_pd(fracBits), fracScale);
+            __m128d frac1 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(fracBits, fracBits)), fracScale);
+
+            __m128d a0 = _mm_set_pd(table[index[1]], table[index[0]]);
+            __m128d a1 = _mm_set_pd(table[index[3]], table[index[2]]);
+            __m128d b0 = _mm_set_pd(table[index[1] + 1], table[index[0] + 1]);
+            __m128d b1 = _mm_set_pd(table[index[3] + 1], table[index[2] + 1]);
+            __m128d value0 = _mm_add_pd(a0, _mm_mul_pd(frac0, _mm_sub_pd(b0, a0)));
+            __m128d value1 = _mm_add_pd(a1, _mm_mul_pd(frac1, _mm_sub_pd(b1, a1)));
+
+            __m128d y = _mm_add_pd(_mm_mul_pd(_mm_mul_pd(gain0, amp0), value0),
+                                   _mm_mul_pd(_mm_mul_pd(gain1, amp1), value1));
+
+            double* acc = scratch + s*numLanes;
+            _mm_storeu_pd(acc, _mm_add_pd(_mm_loadu_pd(acc), y));
+
+            phase = _mm_add_epi32(phase, inc);
+            amp0 = _mm_mul_pd(amp0, decay0);
+            amp1 = _mm_mul_pd(amp1, decay1);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(phases + i), phase);
+        _mm_storeu_pd(envStates + i, amp0);
+        _mm_storeu_pd(envStates + i + 2, amp1);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// 8 interpolated modes in lockstep, float gathers widened to double
+FTM_TARGET_AVX2
+static size_t renderInterpolatedAVX2(const float* table, int tableBits,
+                                     uint32_t* phases, const uint32_t* increments,
+                                     const double* gains, const double* decays, double* envStates,
+                                     size_t begin, size_t end, double* scratch, int numSamples)
+{
+    const __m128i shift = _mm_cvtsi32_si128(32 - tableBits);
+    const __m256i fracMask = _mm256_set1_epi32(int((1u << (32 - tableBits)) - 1));
+    const __m256d fracScale = _mm256_set1_pd(1.0 / double(1u << (32 - tableBits)));
+    const __m128i one = _mm_set1_epi32(1);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256i phase = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(phases + i));
+        __m256i inc = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(increments + i));
+
+        __m256d gain0 = _mm256_loadu_pd(gains + i),      gain1 = _mm256_loadu_pd(gains + i + 4);
+        __m256d decay0 = _mm256_loadu_pd(decays + i),    decay1 = _mm256_loadu_pd(decays + i + 4);
+        __m256d amp0 = _mm256_loadu_pd(envStates + i),   amp1 = _mm256_loadu_pd(envStates + i + 4);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            __m256i index = _mm256_srl_epi32(phase, shift);
+            __m256i fracBits = _mm256_and_si256(phase, fracMask);
+
+            __m128i index0 = _mm256_castsi256_si128(index);
+            __m128i index1 = _mm256_extracti128_si256(index, 1);
+            __m256d a0 = _mm256_cvtps_pd(_mm_i32gather_ps(table, index0, 4));
+            __m256d a1 = _mm256_cvtps_pd(_mm_i32gather_ps(table, index1, 4));
+            __m256d b0 = _mm256_cvtps_pd(_mm_i32gather_ps(table, _mm_add_epi32(index0, one), 4));
+            __m256d b1 = _mm256_cvtps_pd(_mm_i32gather_ps(table, _mm_add_epi32(index1, one), 4));
+
+            __m256d frac0 = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(fracBits)), fracScale);
+            __m256d frac1 = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(fracBits, 1)), fracScale);
+
+            __m256d value0 = _mm256_add_pd(a0, _mm256_mul_pd(frac0, _mm256_sub_pd(b0, a0)));
+            __m256d value1 = _mm256_add_pd(a1, _mm256_mul_pd(frac1, _mm256_sub_pd(b1, a1)));
+
+            __m256d y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(gain0, amp0), value0),
+                                      _mm256_mul_pd(_mm256_mul_pd(gain1, amp1), value1));
+
+            double* acc = scratch + s*numLanes;
+            _mm256_storeu_pd(acc, _mm256_add_pd(_mm256_loadu_pd(acc), y));
+
+            phase = _mm256_add_epi32(phase, inc);
+            amp0 = _mm256_mul_pd(amp0, decay0);
+            amp1 = _mm256_mul_pd(amp1, decay1);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(phases + i), phase);
+        _mm256_storeu_pd(envStates + i, amp0);
+        _mm256_storeu_pd(envStates + i + 4, amp1);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// 4 phasors in lockstep
+static size_t renderPhasorsSSE2(double* re, double* im, const double* rotorRe, const double* rotorIm,
+                                const double* gains, size_t begin, size_t end,
+                                double* scratch, int numSamples)
+{
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128d zr0 = _mm_loadu_pd(re + i),      zr1 = _mm_loadu_pd(re + i + 2);
+        __m128d zi0 = _mm_loadu_pd(im + i),      zi1 = _mm_loadu_pd(im + i + 2);
+        __m128d rr0 = _mm_loadu_pd(rotorRe + i), rr1 = _mm_loadu_pd(rotorRe + i + 2);
+        __m128d ri0 = _mm_loadu_pd(rotorIm + i), ri1 = _mm_loadu_pd(rotorIm + i + 2);
+        __m128d gain0 = _mm_loadu_pd(gains + i), gain1 = _mm_loadu_pd(gains + i + 2);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            __m128d y = _mm_add_pd(_mm_mul_pd(gain0, zi0), _mm_mul_pd(gain1, zi1));
+
+            double* acc = scratch + s*numLanes;
+            _mm_storeu_pd(acc, _mm_add_pd(_mm_loadu_pd(acc), y));
+
+            __m128d nextRe0 = _mm_sub_pd(_mm_mul_pd(zr0, rr0), _mm_mul_pd(zi0, ri0));
+            __m128d nextRe1 = _mm_sub_pd(_mm_mul_pd(zr1, rr1), _mm_mul_pd(zi1, ri1));
+            zi0 = _mm_add_pd(_mm_mul_pd(zr0, ri0), _mm_mul_pd(zi0, rr0));
+            zi1 = _mm_add_pd(_mm_mul_pd(zr1, ri1), _mm_mul_pd(zi1, rr1));
+            zr0 = nextRe0;
+            zr1 = nextRe1;
+        }
+
+        _mm_storeu_pd(re + i, zr0);
+        _mm_storeu_pd(re + i + 2, zr1);
+        _mm_storeu_pd(im + i, zi0);
+        _mm_storeu_pd(im + i + 2, zi1);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// 8 phasors in lockstep
+FTM_TARGET_AVX2
+static size_t renderPhasorsAVX2(double* re, double* im, const double* rotorRe, const double* rotorIm,
+                                const double* gains, size_t begin, size_t end,
+                                double* scratch, int numSamples)
+{
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256d zr0 = _mm256_loadu_pd(re + i),      zr1 = _mm256_loadu_pd(re + i + 4);
+        __m256d zi0 = _mm256_loadu_pd(im + i),      zi1 = _mm256_loadu_pd(im + i + 4);
+        __m256d rr0 = _mm256_loadu_pd(rotorRe + i), rr1 = _mm256_loadu_pd(rotorRe + i + 4);
+        __m256d ri0 = _mm256_loadu_pd(rotorIm + i), ri1 = _mm256_loadu_pd(rotorIm + i + 4);
+        __m256d gain0 = _mm256_loadu_pd(gains + i), gain1 = _mm256_loadu_pd(gains + i + 4);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            __m256d y = _mm256_add_pd(_mm256_mul_pd(gain0, zi0), _mm256_mul_pd(gain1, zi1));
+
+            double* acc = scratch + s*numLanes;
+            _mm256_storeu_pd(acc, _mm256_add_pd(_mm256_loadu_pd(acc), y));
+
+            __m256d nextRe0 = _mm256_sub_pd(_mm256_mul_pd(zr0, rr0), _mm256_mul_pd(zi0, ri0));
+            __m256d nextRe1 = _mm256_sub_pd(_mm256_mul_pd(zr1, rr1), _mm256_mul_pd(zi1, ri1));
+            zi0 = _mm256_add_pd(_mm256_mul_pd(zr0, ri0), _mm256_mul_pd(zi0, rr0));
+            zi1 = _mm256_add_pd(_mm256_mul_pd(zr1, ri1), _mm256_mul_pd(zi1, rr1));
+            zr0 = nextRe0;
+            zr1 = nextRe1;
+        }
+
+        _mm256_storeu_pd(re + i, zr0);
+        _mm256_storeu_pd(re + i + 4, zr1);
+        _mm256_storeu_pd(im + i, zi0);
+        _mm256_storeu_pd(im + i + 4, zi1);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// 4 single-precision modes in lockstep
+static size_t renderFloatSSE2(const float* sinTable, int sinTableShift,
+                              uint32_t* phases, const uint32_t* increments,
+                              const float* gains, const float* decays, float* envStates,
+                              size_t begin, size_t end, float* scratch, int numSamples)
+{
+    const __m128i shift = _mm_cvtsi32_si128(sinTableShift);
+    alignas(16) uint32_t index[4];
+
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128i phase = _mm_loadu_si128(reinterpret_cast<const __m128i*>(phases + i));
+        __m128i inc = _mm_loadu_si128(reinterpret_cast<const __m128i*>(increments + i));
+
+        __m128 gain = _mm_loadu_ps(gains + i);
+        __m128 decay = _mm_loadu_ps(decays + i);
+        __m128 amp = _mm_loadu_ps(envStates + i);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_srl_epi32(phase, shift));
+            __m128 value = _mm_set_ps(sinTable[index[3]], sinTable[index[2]],
+                                      sinTable[index[1]], sinTable[index[0]]);
+
+            __m128 y = _mm_mul_ps(_mm_mul_ps(gain, amp), value);
+
+            float* acc = scratch + s*numFloatLanes;
+            _mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), y));
+
+            phase = _mm_add_epi32(phase, inc);
+            amp = _mm_mul_ps(amp, decay);
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(phases + i), phase);
+        _mm_storeu_ps(envStates + i, amp);
+    }
+
+    return i - begin;
+}
+
+//==================================
+// 16 single-precision modes in lockstep (two vectors of 8), one gather per vector and sample
+FTM_TARGET_AVX2
+static size_t renderFloatAVX2(const float* sinTable, int sinTableShift,
+                              uint32_t* phases, const uint32_t* increments,
+                              const float* gains, const float* decays, float* envStates,
+                              size_t begin, size_t end, float* scratch, int numSamples)
+{
+    const __m128i shift = _mm_cvtsi32_si128(sinTableShift);
+
+    size_t i = begin;
+    for (; i + 16 <= end; i += 16)
+    {
+        __m256i phase0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(phases + i));
+        __m256i phase1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(phases + i + 8));
+        __m256i inc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(increments + i));
+        __m256i inc1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(increments + i + 8));
+
+        __m256 gain0 = _mm256_loadu_ps(gains + i),      gain1 = _mm256_loadu_ps(gains + i + 8);
+        __m256 decay0 = _mm256_loadu_ps(decays + i),    decay1 = _mm256_loadu_ps(decays + i + 8);
+        __m256 amp0 = _mm256_loadu_ps(envStates + i),   amp1 = _mm256_loadu_ps(envStates + i + 8);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            __m256 value0 = _mm256_i32gather_ps(sinTable, _mm256_srl_epi32(phase0, shift), 4);
+            __m256 value1 = _mm256_i32gather_ps(sinTable, _mm256_srl_epi32(phase1, shift), 4);
+
+            __m256 y = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(gain0, amp0), value0),
+                                     _mm256_mul_ps(_mm256_mul_ps(gain1, amp1), value1));
+
+            float* acc = scratch + s*numFloatLanes;
+            _mm256_storeu_ps(acc, _mm256_add_ps(_mm256_loadu_ps(acc), y));
+
+            phase0 = _mm256_add_epi32(phase0, inc0);
+            phase1 = _mm256_add_epi32(phase1, inc1);
+            amp0 = _mm256_mul_ps(amp0, decay0);
+            amp1 = _mm256_mul_ps(amp1, decay1);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(phases + i), phase0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(phases + i + 8), phase1);
+        _mm256_storeu_ps(envStates + i, amp0);
+        _mm256_storeu_ps(envStates + i + 8, amp1);
+    }
+
+    return i - begin;
+}
+#endif
+
+
+//==================================
+// The division of the mode index goes through doubles so that the AVX2 kernel can do the same
+// (exact, the fractional part of (index + 0.5) / size1 stays away from 0 and 1)
+static size_t retuneScalar(const ModeBank::AxisTables& tables, const int* modeIndex,
+                           double a, double b, double c, double incrementScale, bool scaleGains,
+                           uint32_t* increments, double* gains, double* decays, size_t begin, size_t end)
+{
+    double inverse1 = 1.0 / tables.size1;
+
+    for (size_t m = begin; m < end; m++)
+    {
+        int index = modeIndex[m];
+        int j = int((index + 0.5) * inverse1);
+        int i = index - j * tables.size1;
+
+        double n = tables.terms1[i] + tables.terms2[j];
+        double increment = std::sqrt(std::abs((a*n + b)*n + c)) * incrementScale;
+        decays[m] = tables.decays1[i] * tables.decays2[j];
+
+        // modes past Nyquist are held there, where the voice skips them, and their gains follow
+        // the clamped increment so that they come back unchanged
+        if (!(increment < 2147483648.0))
+            increment = 2147483648.0;
+        if (scaleGains && increments[m] > 0 && increment >= 1.0)
+            gains[m] *= double(increments[m]) / increment;
+
+        // rounded, as the next retune scales the gains by it: truncating would make them drift
+        // down a little more at every step of a long modulation
+        increments[m] = uint32_t(increment + 0.5);
+    }
+
+    return end - begin;
+}
+
+#if FTM_MODEBANK_X86
+FTM_TARGET_AVX2
+static size_t retuneAVX2(const ModeBank::AxisTables& tables, const int* modeIndex,
+                         double a, double b, double c, double incrementScale, bool scaleGains,
+                         uint32_t* increments, double* gains, double* decays, size_t begin, size_t end)
+{
+    const __m256d inverse1 = _mm256_set1_pd(1.0 / tables.size1);
+    const __m128i size1 = _mm_set1_epi32(tables.size1);
+    const __m256d half = _mm256_set1_pd(0.5);
+    const __m256d av = _mm256_set1_pd(a);
+    const __m256d bv = _mm256_set1_pd(b);
+    const __m256d cv = _mm256_set1_pd(c);
+    const __m256d scale = _mm256_set1_pd(incrementScale);
+    const __m256d nyquist = _mm256_set1_pd(2147483648.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d signBit = _mm256_set1_pd(-0.0);
+    const __m256d wrap = _mm256_set1_pd(4294967296.0);
+
+    size_t m = begin;
+    for (; m + 4 <= end; m += 4)
+    {
+        __m128i index = _mm_loadu_si128(reinterpret_cast<const __m128i*>(modeIndex + m));
+        __m128i row = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_add_pd(_mm256_cvtepi32_pd(index), half), inverse1));
+        __m128i column = _mm_sub_epi32(index, _mm_mullo_epi32(row, size1));
+
+        // plain loads, faster than _mm256_i32gather_pd on the CPUs we measured
+        alignas(16) int i[4], j[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(i), column);
+        _mm_store_si128(reinterpret_cast<__m128i*>(j), row);
+        __m256d n = _mm256_add_pd(
+            _mm256_setr_pd(tables.terms1[i[0]], tables.terms1[i[1]], tables.terms1[i[2]], tables.terms1[i[3]]),
+            _mm256_setr_pd(tables.terms2[j[0]], tables.terms2[j[1]], tables.terms2[j[2]], tables.terms2[j[3]]));
+        __m256d decay = _mm256_mul_pd(
+            _mm256_setr_pd(tables.decays1[i[0]], tables.decays1[i[1]], tables.decays1[i[2]], tables.decays1[i[3]]),
+            _mm256_setr_pd(tables.decays2[j[0]], tables.decays2[j[1]], tables.decays2[j[2]], tables.decays2[j[3]]));
+
+        __m256d omega2 = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(av, n), bv), n), cv);
+        __m256d increment = _mm256_mul_pd(_mm256_sqrt_pd(_mm256_andnot_pd(signBit, omega2)), scale);
+        increment = _mm256_min_pd(increment, nyquist);  // also for NaN, min_pd returns the second operand
+
+        __m256d gain = _mm256_loadu_pd(gains + m);
+        if (scaleGains)
+        {
+            // the old increments are at most Nyquist, which reads as -2^31 in signed integers
+            __m256d previous = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(increments + m)));
+            previous = _mm256_add_pd(previous, _mm256_and_pd(_mm256_cmp_pd(previous, _mm256_setzero_pd(), _CMP_LT_OQ), wrap));
+            __m256d valid = _mm256_and_pd(_mm256_cmp_pd(previous, _mm256_setzero_pd(), _CMP_GT_OQ),
+                                          _mm256_cmp_pd(increment, one, _CMP_GE_OQ));
+            gain = _mm256_mul_pd(gain, _mm256_blendv_pd(one, _mm256_div_pd(previous, increment), valid));
+        }
+
+        // rounded to nearest like retuneScalar(). 2^31 converts to 0x80000000 (the "integer
+        // indefinite" value), which is the increment we want
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(increments + m), _mm256_cvtpd_epi32(increment));
+        _mm256_storeu_pd(gains + m, gain);
+        _mm256_storeu_pd(decays + m, decay);
+    }
+
+    return m - begin;
+}
+#endif
+
+
+//==================================
+ModeBank::InstructionSet ModeBank::getInstructionSet()
+{
+   #if FTM_MODEBANK_X86
+    static const InstructionSet detected = (SystemStats::hasAVX2() ? InstructionSet::avx2
+                                                                   : InstructionSet::sse2);
+    return detected;
+   #else
+    return InstructionSet::scalar;
+   #endif
+}
+
+size_t ModeBank::getScratchSize(int numSamples)
+{
+    return size_t(numSamples) * numLanes;
+}
+
+size_t ModeBank::getFloatScratchSize(int numSamples)
+{
+    return size_t(numSamples) * numFloatLanes;
+}
+
+void ModeBank::render(const double* sinTable, int sinTableShift,
+                      uint32_t* phases, const uint32_t* increments,
+                      const int32_t* incrementSteps, const uint32_t* incrementStepFractions,
+                      const double* gains, const double* decays, double* envStates,
+                      size_t numModes, double* output, int numSamples, double* scratch)
+{
+    render(getInstructionSet(), sinTable, sinTableShift, phases, increments, incrementSteps,
+           incrementStepFractions, gains, decays, envStates, numModes, output, numSamples, scratch);
+}
+
+// render() with the ramp (or its absence) known at compile time
+template <bool ramp>
+static void renderModes(ModeBank::InstructionSet instructionSet, const double* sinTable, int sinTableShift,
+                        uint32_t* phases, const uint32_t* increments,
+                        const int32_t* incrementSteps, const uint32_t* incrementStepFractions,
+                        const double* gains, const double* decays, double* envStates,
+                        size_t numModes, double* output, int numSamples, double* scratch)
+{
+    size_t done = 0;
+
+   #if FTM_MODEBANK_X86
+    if (instructionSet != ModeBank::InstructionSet::scalar && numModes >= 4)
+    {
+        std::fill(scratch, scratch + ModeBank::getScratchSize(numSamples), 0.0);
+
+        if (instructionSet == ModeBank::InstructionSet::avx2)
+            done += renderAVX2<ramp>(sinTable, sinTableShift, phases, increments, incrementSteps,
+                                     incrementStepFractions, gains, decays, envStates, done, numModes,
+                                     scratch, numSamples);
+
+        done += renderSSE2<ramp>(sinTable, sinTableShift, phases, increments, incrementSteps,
+                                 incrementStepFractions, gains, decays, envStates, done, numModes,
+                                 scratch, numSamples);
+
+        // sum the accumulator lanes into the output
+        for (int s = 0; s < numSamples; s++)
+        {
+            const double* acc = scratch + s*numLanes;
+            output[s] += (acc[0] + acc[1]) + (acc[2] + acc[3]);
+        }
+    }
+   #else
+    ignoreUnused(instructionSet, scratch);
+   #endif
+
+    // leftover modes (or everything when no SIMD is available)
+    renderScalar<ramp>(sinTable, sinTableShift, phases, increments, incrementSteps, incrementStepFractions,
+                       gains, decays, envStates, done, numModes, output, numSamples);
+}
+
+void ModeBank::render(InstructionSet instructionSet, const double* sinTable, int sinTableShift,
+                      uint32_t* phases, const uint32_t* increments,
+                      const int32_t* incrementSteps, const uint32_t* incrementStepFractions,
+                      const double* gains, const double* decays, double* envStates,
+                      size_t numModes, double* output, int numSamples, double* scratch)
+{
+    if (incrementSteps != nullptr)
+        renderModes<true>(instructionSet, sinTable, sinTableShift, phases, increments, incrementSteps,
+                          incrementStepFractions, gains, decays, envStates, numModes, output, numSamples,
+                          scratch);
+    else
+        renderModes<false>(instructionSet, sinTable, sinTableShift, phases, increments, nullptr, nullptr,
+                           gains, decays, envStates, numModes, output, numSamples, scratch);
+}
+
+void ModeBank::renderBlockExponential(const double* sinTable, int sinTableShift,
+                                      uint32_t* phases, const uint32_t* increments,
+                                      const double* gains, const double* decays,
+                                      const double* decayPowers, const double* chunkDecays,
+                                      double* envStates, size_t numModes, double* output, int numSamples)
+{
+   #if FTM_MODEBANK_X86
+    if (getInstructionSet() == InstructionSet::avx2)
+    {
+        renderBlockExponentialAVX2(sinTable, sinTableShift, phases, increments, gains, decays,
+                                   decayPowers, chunkDecays, envStates, 0, numModes, output, numSamples);
+        return;
+    }
+   #endif
+
+    renderBlockExponentialScalar(sinTable, sinTableShift, phases, increments, gains, decays,
+                                 decayPowers, chunkDecays, envStates, 0, numModes, output, numSamples);
+}
+
+void ModeBank::renderInterpolated(const float* table, int tableBits,
+                                  uint32_t* phases, const uint32_t* increments,
+                                  const double* gains, const double* decays, double* envStates,
+                                  size_t numModes, double* output, int numSamples, double* scratch)
+{
+    renderInterpolated(getInstructionSet(), table, tableBits, phases, increments, gains, decays,
+                       envStates, numModes, output, numSamples, scratch);
+}
+
+void ModeBank::renderInterpolated(InstructionSet instructionSet, const float* table, int tableBits,
+                                  uint32_t* phases, const uint32_t* increments,
+                                  const double* gains, const double* decays, double* envStates,
+                                  size_t numModes, double* output, int numSamples, double* scratch)
+{
+    size_t done = 0;
+
+   #if FTM_MODEBANK_X86
+    if (instructionSet != InstructionSet::scalar && numModes >= 4)
+    {
+        std::fill(scratch, scratch + getScratchSize(numSamples), 0.0);
+
+        if (instructionSet == InstructionSet::avx2)
+            done += renderInterpolatedAVX2(table, tableBits, phases, increments, gains, decays,
+                                           envStates, done, numModes, scratch, numSamples);
+
+        done += renderInterpolatedSSE2(table, tableBits, phases, increments, gains, decays,
+                                       envStates, done, numModes, scratch, numSamples);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            const double* acc = scratch + s*numLanes;
+            output[s] += (acc[0] + acc[1]) + (acc[2] + acc[3]);
+        }
+    }
+   #else
+    ignoreUnused(instructionSet, scratch);
+   #endif
+
+    renderInterpolatedScalar(table, tableBits, phases, increments, gains, decays, envStates,
+                             done, numModes, output, numSamples);
+}
+
+void ModeBank::renderPhasors(double* re, double* im, const double* rotorRe, const double* rotorIm,
+                             const double* gains, size_t numModes, double* output, int numSamples,
+                             double* scratch)
+{
+    renderPhasors(getInstructionSet(), re, im, rotorRe, rotorIm, gains, numModes, output,
+                  numSamples, scratch);
+}
+
+void ModeBank::renderPhasors(InstructionSet instructionSet,
+                             double* re, double* im, const double* rotorRe, const double* rotorIm,
+                             const double* gains, size_t numModes, double* output, int numSamples,
+                             double* scratch)
+{
+    size_t done = 0;
+
+   #if FTM_MODEBANK_X86
+    if (instructionSet != InstructionSet::scalar && numModes >= 4)
+    {
+        std::fill(scratch, scratch + getScratchSize(numSamples), 0.0);
+
+        if (instructionSet == InstructionSet::avx2)
+            done += renderPhasorsAVX2(re, im, rotorRe, rotorIm, gains, done, numModes, scratch, numSamples);
+
+        done += renderPhasorsSSE2(re, im, rotorRe, rotorIm, gains, done, numModes, scratch, numSamples);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            const double* acc = scratch + s*numLanes;
+            output[s] += (acc[0] + acc[1]) + (acc[2] + acc[3]);
+        }
+    }
+   #else
+    ignoreUnused(instructionSet, scratch);
+   #endif
+
+    renderPhasorsScalar(re, im, rotorRe, rotorIm, gains, done, numModes, output, numSamples);
+}
+
+void ModeBank::renderFloat(const float* sinTable, int sinTableShift,
+                           uint32_t* phases, const uint32_t* increments,
+                           const float* gains, const float* decays, float* envStates,
+                           size_t numModes, float* output, int numSamples, float* scratch)
+{
+    renderFloat(getInstructionSet(), sinTable, sinTableShift, phases, increments, gains, decays,
+                envStates, numModes, output, numSamples, scratch);
+}
+
+void ModeBank::renderFloat(InstructionSet instructionSet, const float* sinTable, int sinTableShift,
+                           uint32_t* phases, const uint32_t* increments,
+                           const float* gains, const float* decays, float* envStates,
+                           size_t numModes, float* output, int numSamples, float* scratch)
+{
+    size_t done = 0;
+
+   #if FTM_MODEBANK_X86
+    if (instructionSet != InstructionSet::scalar && numModes >= 4)
+    {
+        std::fill(scratch, scratch + getFloatScratchSize(numSamples), 0.0f);
+
+        if (instructionSet == InstructionSet::avx2)
+            done += renderFloatAVX2(sinTable, sinTableShift, phases, increments, gains, decays,
+                                    envStates, done, numModes, scratch, numSamples);
+
+        done += renderFloatSSE2(sinTable, sinTableShift, phases, increments, gains, decays,
+                                envStates, done, numModes, scratch, numSamples);
+
+        for (int s = 0; s < numSamples; s++)
+        {
+            const float* acc = scratch + s*numFloatLanes;
+            output[s] += ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+        }
+    }
+   #else
+    ignoreUnused(instructionSet, scratch);
+   #endif
+
+    renderFloatScalar(sinTable, sinTableShift, phases, increments, gains, decays, envStates,
+                      done, numModes, output, numSamples);
+}
+
+void ModeBank::retune(const AxisTables& tables, const int* modeIndex,
+                      double a, double b, double c, double incrementScale, bool scaleGains,
+                      uint32_t* increments, double* gains, double* decays, size_t numModes)
+{
+    size_t done = 0;
+
+   #if FTM_MODEBANK_X86
+    if (getInstructionSet() == InstructionSet::avx2)
+        done += retuneAVX2(tables, modeIndex, a, b, c, incrementScale, scaleGains,
+                           increments, gains, decays, 0, numModes);
+   #endif
+
+    retuneScalar(tables, modeIndex, a, b, c, incrementScale, scaleGains,
+                 increments, gains, decays, done, numModes);
+}
@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    ModeTablePreparer.cpp
+    Created: 17 Oct 2026 12:00:51pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "ModeTablePreparer.h"
+
+
+ModeTablePreparer::ModeTablePreparer(AudioProcessorValueTreeState& _tree)
+    : Thread("FTMSynth mode tables"),
+      patchParamSource(_tree)
+{
+}
+
+ModeTablePreparer::~ModeTablePreparer()
+{
+    stop();
+
+    // nothing renders anymore
+    delete pending.exchange(nullptr);
+    delete current;
+    freeRetiredTables();
+}
+
+void ModeTablePreparer::start()
+{
+    startThread();
+}
+
+void ModeTablePreparer::stop()
+{
+    stopThread(1000);
+}
+
+void ModeTablePreparer::patchChanged()
+{
+    notify();
+}
+
+void ModeTablePreparer::setSampleRate(double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    notify();
+}
+
+//==================================
+const ModeTable* ModeTablePreparer::getTable()
+{
+    // the replaced tables need somewhere to go, otherwise keep the current ones for now
+    if (pending.load() != nullptr && retiredFifo.getFreeSpace() > 0)
+    {
+        ModeTable* fresh = pending.exchange(nullptr);
+        if (current != nullptr)
+        {
+            const auto write = retiredFifo.write(1);
+            write.forEach([this](int index) { retired[index] = current; });
+        }
+        current = fresh;
+    }
+    return current;
+}
+
+void ModeTablePreparer::run()
+{
+    while (!threadShouldExit())
+    {
+        freeRetiredTables();
+
+        double rate = sampleRate.load();
+        if (rate > 0)
+        {
+            // same parameters as the voices, see FTMSynthAudioProcessor::processBlock()
+            patchParamSource.read(patchParams);
+            tableVoice.setPatchParams(patchParams);
+
+            ModeTable::Patch patch = tableVoice.getNextPatch(rate);
+            if (!hasLastPatch || !(patch == lastPatch))
+            {
+                ModeTable* table = new ModeTable();
+                tableVoice.computeModeTable(patch, *table);
+
+                // tables the audio thread never saw can go straight away
+                delete pending.exchange(table);
+
+                lastPatch = patch;
+                hasLastPatch = true;
+            }
+        }
+
+        // also wakes up now and then to free the replaced tables
+        wait(500);
+    }
+}
+
+void ModeTablePreparer::freeRetiredTables()
+{
+    const auto read = retiredFifo.read(retiredFifo.getNumReady());
+    read.forEach([this](int index)
+    {
+        delete retired[index];
+        retired[index] = nullptr;
+    });
+}
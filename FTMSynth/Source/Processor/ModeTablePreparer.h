@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    ModeTablePreparer.h
+    Created: 17 Oct 2026 12:00:51pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+#include "SynthVoice.h"
+
+
+// Keeps the patch part of the mode tables (ModeTable) up to date on a background thread, so that
+// note-ons only have to scale them to the note instead of computing them on the audio thread.
+//
+// Tables are published through an atomic pointer and picked up by the audio thread with getTable()
+// at the start of a block. The tables it replaces go back through a FIFO and are deleted here, so
+// the audio thread never allocates nor frees them.
+class ModeTablePreparer : private Thread
+{
+public:
+    explicit ModeTablePreparer(AudioProcessorValueTreeState& tree);
+    ~ModeTablePreparer() override;
+
+    // Starts or stops the background thread (message thread)
+    void start();
+    void stop();
+
+    // Asks for new tables after a parameter or sample rate change (any thread)
+    void patchChanged();
+    void setSampleRate(double newSampleRate);
+
+    // Latest tables, nullptr until the first ones are ready. Audio thread only, the tables stay
+    // valid until the next call.
+    const ModeTable* getTable();
+
+private:
+    void run() override;
+    void freeRetiredTables();
+
+    PatchParamSource patchParamSource;
+    PatchParams patchParams;  // this thread's own copy
+    SynthVoice tableVoice;  // computes the tables with the same code as the playing voices
+    std::atomic<double> sampleRate { 0.0 };
+
+    ModeTable::Patch lastPatch;
+    bool hasLastPatch = false;
+
+    std::atomic<ModeTable*> pending { nullptr };  // published, not picked up yet
+    ModeTable* current = nullptr;                 // audio thread
+
+    static constexpr int maxRetired = 16;
+    AbstractFifo retiredFifo { maxRetired };
+    ModeTable* retired[maxRetired] = {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ModeTablePreparer)
+};
@@ -0,0 +1,83 @@
+/*
+  ==============================================================================
+
+    NoteTableCache.cpp
+    Created: 17 Oct 2026 12:04:50pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "NoteTableCache.h"
+
+#include <algorithm>
+
+
+void NoteTableCache::allocate(int maxModes, size_t memoryLimit)
+{
+    size_t entryBytes = size_t(maxModes) * (2 * sizeof(double) + sizeof(uint8_t));
+    int numEntries = int(std::min(memoryLimit / std::max(entryBytes, size_t(1)), size_t(maxEntries)));
+
+    entryModes = maxModes;
+    entries.assign(numEntries, Entry());
+    values.assign(size_t(numEntries) * maxModes * 2, 0.0);
+    flags.assign(size_t(numEntries) * maxModes, 0);
+
+    for (int e = 0; e < numEntries; e++)
+    {
+        entries[e].omega = values.data() + size_t(2*e) * maxModes;
+        entries[e].gain = values.data() + size_t(2*e + 1) * maxModes;
+        entries[e].rejected = flags.data() + size_t(e) * maxModes;
+    }
+    useCount = 0;
+}
+
+const NoteTableCache::Entry* NoteTableCache::find(const ModeTable::Patch& patch, double fomega)
+{
+    for (Entry& entry : entries)
+    {
+        if (entry.valid && entry.fomega == fomega && entry.patch == patch)
+        {
+            entry.lastUse = ++useCount;
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+NoteTableCache::Entry* NoteTableCache::add(const ModeTable::Patch& patch, double fomega, int numModes)
+{
+    if (entries.empty() || numModes > entryModes) return nullptr;
+
+    // free entries have lastUse = 0
+    Entry* oldest = &entries[0];
+    for (Entry& entry : entries)
+    {
+        if (entry.lastUse < oldest->lastUse)
+            oldest = &entry;
+    }
+
+    oldest->patch = patch;
+    oldest->fomega = fomega;
+    oldest->numModes = numModes;
+    oldest->lastUse = ++useCount;
+    oldest->valid = true;
+    return oldest;
+}
@@ -0,0 +1,84 @@
+/*
+  ==============================================================================
+
+    NoteTableCache.h
+    Created: 17 Oct 2026 12:04:50pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "SynthVoice.h"
+
+#ifndef FTM_DEFAULT_NOTE_TABLE_CACHE_MB
+ #define FTM_DEFAULT_NOTE_TABLE_CACHE_MB  16  // memory for the per-key mode tables (0 = no cache)
+#endif
+
+
+// The per-note part of the mode tables (omega, gains, aliased modes and the findmax() normalisation)
+// of the last keys played, so that playing one of them again only copies them.
+//
+// Entries are keyed by patch and fomega, i.e. by MIDI note with kbTrack (a single entry without it),
+// and don't depend on the velocity. The least recently used one is replaced when the cache is full,
+// so the entries of a previous patch are never hit again and age out on their own.
+//
+// allocate() runs on the message thread, on a cache nothing renders from yet (the processor swaps
+// it in under the callback lock), find() and add() are for SynthVoice::startNote() on the audio
+// thread and don't allocate.
+class NoteTableCache
+{
+public:
+    static constexpr int maxEntries = 256;  // two patches' worth of keys
+
+    struct Entry
+    {
+        ModeTable::Patch patch;
+        double fomega = 0;
+        int numModes = 0;
+        double maxh = 1;
+        double* omega = nullptr;
+        double* gain = nullptr;        // knd (Selesnick only, the Rabenstein ones come from modeGain and omega)
+        uint8_t* rejected = nullptr;
+        uint64_t lastUse = 0;
+        bool valid = false;
+    };
+
+    // Splits memoryLimit bytes into entries of maxModes modes, dropping the current ones
+    void allocate(int maxModes, size_t memoryLimit);
+
+    // Entry of this patch and pitch, or nullptr
+    const Entry* find(const ModeTable::Patch& patch, double fomega);
+
+    // Entry to fill for this patch and pitch in place of the least recently used one,
+    // or nullptr if the cache has no memory for numModes modes
+    Entry* add(const ModeTable::Patch& patch, double fomega, int numModes);
+
+private:
+    std::vector<Entry> entries;
+    std::vector<double> values;
+    std::vector<uint8_t> flags;
+    int entryModes = 0;
+    uint64_t useCount = 0;
+};
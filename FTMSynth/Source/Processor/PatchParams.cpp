@@ -0,0 +1,87 @@
+/*
+  ==============================================================================
+
+    PatchParams.cpp
+    Created: 17 Oct 2026 12:40:05pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "PatchParams.h"
+
+
+static const struct
+{
+    const char* id;
+    float PatchParams::* value;
+}
+patchParamTable[] = {
+    { "algorithm",  &PatchParams::algorithm },
+    { "volume",     &PatchParams::volume },
+    { "attack",     &PatchParams::attack },
+    { "pitch",      &PatchParams::pitch },
+    { "kbTrack",    &PatchParams::kbTrack },
+    { "sustain",    &PatchParams::sustain },
+    { "susGate",    &PatchParams::susGate },
+    { "release",    &PatchParams::release },
+    { "damp",       &PatchParams::damp },
+    { "dampGate",   &PatchParams::dampGate },
+    { "ring",       &PatchParams::ring },
+    { "dispersion", &PatchParams::dispersion },
+    { "alpha2d",    &PatchParams::alpha2d },
+    { "alpha3d",    &PatchParams::alpha3d },
+    { "r1",         &PatchParams::r1 },
+    { "r2",         &PatchParams::r2 },
+    { "r3",         &PatchParams::r3 },
+    { "m1",         &PatchParams::m1 },
+    { "m2",         &PatchParams::m2 },
+    { "m3",         &PatchParams::m3 },
+    { "dimensions", &PatchParams::dimensions },
+};
+
+
+PatchParamSource::PatchParamSource(AudioProcessorValueTreeState& tree)
+{
+    static_assert(std::size(patchParamTable) == numParams, "one value per parameter");
+
+    // the raw values, and not tree.getParameterAsValue(), which is only updated after the next
+    // note-on, so that a note always plays with the parameters set before it
+    for (int i = 0; i < numParams; i++)
+    {
+        values[i] = tree.getRawParameterValue(patchParamTable[i].id);
+        jassert(values[i] != nullptr);
+    }
+}
+
+void PatchParamSource::read(PatchParams& params) const
+{
+    bool changed = (params.version == 0);
+    for (int i = 0; i < numParams; i++)
+    {
+        float value = values[i]->load();
+        if (params.*patchParamTable[i].value != value)
+        {
+            params.*patchParamTable[i].value = value;
+            changed = true;
+        }
+    }
+    if (changed) params.version++;
+}
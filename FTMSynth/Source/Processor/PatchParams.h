@@ -0,0 +1,78 @@
+/*
+  ==============================================================================
+
+    PatchParams.h
+    Created: 17 Oct 2026 12:40:05pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <JuceHeader.h>
+
+
+// Values of the parameters the voices play with, read once per block and shared by all the
+// voices. version changes whenever one of the values does, so that a voice only has to compare
+// it to the one it last applied.
+struct PatchParams
+{
+    float algorithm = 0;
+    float volume = 0;
+    float attack = 0;
+    float pitch = 0;
+    float kbTrack = 0;
+    float sustain = 0;
+    float susGate = 0;
+    float release = 0;
+    float damp = 0;
+    float dampGate = 0;
+    float ring = 0;
+    float dispersion = 0;
+    float alpha2d = 0;
+    float alpha3d = 0;
+    float r1 = 0;
+    float r2 = 0;
+    float r3 = 0;
+    float m1 = 0;
+    float m2 = 0;
+    float m3 = 0;
+    float dimensions = 0;
+
+    uint64_t version = 0;  // 0 = never read
+};
+
+
+// The raw values of a tree's patch parameters, looked up once
+class PatchParamSource
+{
+public:
+    explicit PatchParamSource(AudioProcessorValueTreeState& tree);
+
+    // Copies the current values into params, and bumps its version if any of them changed
+    void read(PatchParams& params) const;
+
+private:
+    static constexpr int numParams = 21;
+    std::atomic<float>* values[numParams];
+};
@@ -28,6 +28,12 @@
 #include "PluginProcessor.h"
 #include "../View/PluginEditor.h"
 
+// parameters the patch part of the mode tables depends on (see ModeTable::Patch)
+static const char* const modeTableParameters[] = {
+    "algorithm", "sustain", "damp", "dispersion", "alpha2d", "alpha3d",
+    "r1", "r2", "r3", "m1", "m2", "m3", "dimensions"
+};
+
 //==============================================================================
 FTMSynthAudioProcessor::FTMSynthAudioProcessor()
     :
@@ -87,17 +93,23 @@ FTMSynthAudioProcessor::FTMSynthAudioProcessor()
         std::make_unique<AudioParameterInt>(ParameterID("m3", 1), "Modes Z", 1, MAX_M3, 5),
         std::make_unique<AudioParameterBool>(ParameterID("modesLink", 1), "Link Modes", false),
         std::make_unique<AudioParameterInt>(ParameterID("dimensions", 1), "Dimensions", 1, 3, 2),
-        std::make_unique<AudioParameterInt>(ParameterID("voices", 1), "Polyphony voices", 1, 16, 4)
+        std::make_unique<AudioParameterInt>(ParameterID("voices", 1), "Polyphony voices", 1, MAX_VOICES, 4)
     })
 {
     SynthVoice::computeSinLUT();
+    SpectralModeBank::computeKernel();
+    BandUpsampler::computeFilter();
 
-    // clear and add voices
+    // clear and add voices, all of them so that the audio thread never allocates one
     mySynth.clearVoices();
+    voiceAllocator.setNumVoices(MAX_VOICES);
     int numVoices = int(tree.getRawParameterValue("voices")->load());
-    for (int i = 0; i < numVoices; i++)
+    for (int i = 0; i < MAX_VOICES; i++)
     {
-        mySynth.addVoice(new SynthVoice());
+        SynthVoice* newVoice = new SynthVoice();
+        newVoice->setVoiceAllocator(&voiceAllocator, i);
+        newVoice->setEnabled(i < numVoices);
+        mySynth.addVoice(newVoice);
     }
 
     // clear and add sounds
@@ -109,11 +121,22 @@ FTMSynthAudioProcessor::FTMSynthAudioProcessor()
         midiMappings[paramTable[i].paramID] = std::make_unique<MidiMappingEntry>();
 
     loadGlobalMidiMappings();
+
+    // the voices' mode tables are sized and computed from these
+    reserveModes();
+    for (auto id : modeTableParameters)
+        tree.addParameterListener(id, this);
+    modeTablePreparer.start();
 }
 
 
 FTMSynthAudioProcessor::~FTMSynthAudioProcessor()
 {
+    voiceRenderPool.stop();
+    modeTablePreparer.stop();
+    for (auto id : modeTableParameters)
+        tree.removeParameterListener(id, this);
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -183,15 +206,24 @@ void FTMSynthAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBloc
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
-    ignoreUnused(samplesPerBlock);
     lastSampleRate=sampleRate;
     mySynth.setCurrentPlaybackSampleRate(lastSampleRate);
+    reserveModes();
+    for (int i = 0; i < mySynth.getNumVoices(); i++)
+        if (auto* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+            myVoice->reserveBlockSize(samplesPerBlock);
+
+    // nothing renders here, the workers can be restarted
+    voiceRenderPool.prepare(renderThreads.load(), samplesPerBlock, getTotalNumOutputChannels());
+    mySynth.setRenderPool(&voiceRenderPool);
+    modeTablePreparer.setSampleRate(lastSampleRate);
 }
 
 void FTMSynthAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    voiceRenderPool.stop();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -220,81 +252,12 @@ bool FTMSynthAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts)
 
 void FTMSynthAudioProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
 {
-    // Change the number of voices if needed
-    int deltaVoices = int(tree.getRawParameterValue("voices")->load());
-    deltaVoices -= mySynth.getNumVoices();
-
-    if (deltaVoices > 0)
-    {
-        // Add new free voice
-        for (int i = 0; i < deltaVoices; i++)
-            mySynth.addVoice(new SynthVoice());
-    }
-    else if (deltaVoices < 0)
-    {
-        // Remove all found inactive voices starting from the end
-        int removedVoices = 0;
-        int voice = mySynth.getNumVoices()-1;
-        while (voice > 0)
-        {
-            SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(voice));
-            if (myVoice != nullptr)
-            {
-                if (!myVoice->isVoiceActive())
-                {
-                    mySynth.removeVoice(voice);
-                    removedVoices++;
-                }
-            }
-            voice--;
-
-            if (removedVoices >= (-deltaVoices)) break;
-        }
-
-        // If after a first pass, not enough voices were removed
-        // then cut the least recent voices starting from the oldest
-        if (removedVoices < (-deltaVoices))
-        {
-            SynthesiserVoice* voiceToCompare;
-            int oldest;
-
-            int leftToRemove = -deltaVoices;
-            while (leftToRemove > 0)
-            {
-                oldest = -1;
-                int voiceCount = mySynth.getNumVoices();
+    // decaying float envelopes would otherwise end up in (very slow) denormal range
+    ScopedNoDenormals noDenormals;
 
-                for (int i = 0; i < voiceCount; i++)
-                {
-                    SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i));
-                    bool isOldest = true;  // until proven otherwise
-
-                    for (int j = 0; j < voiceCount; j++)
-                    {
-                        if (i != j)
-                        {
-                            voiceToCompare = mySynth.getVoice(j);
-
-                            if (myVoice != nullptr)
-                            {
-                                if (!myVoice->wasStartedBefore(*voiceToCompare))
-                                    isOldest = false;
-                            }
-                        }
-                    }
-                    if (isOldest)
-                    {
-                        oldest = i;
-                    }
-                }
-                if (oldest != -1)
-                {
-                    mySynth.removeVoice(oldest);
-                    leftToRemove--;
-                }
-            }
-        }
-    }
+    // Change the number of voices if needed
+    voiceAllocator.setStealing(voiceStealing.load());
+    updateEnabledVoices();
 
     // Unified MIDI message processing
     MidiBuffer filteredMidi;
@@ -343,6 +306,7 @@ void FTMSynthAudioProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer
 
                     if (changed)
                     {
+                        midiMappingsChanged = true;
                         triggerAsyncUpdate();  // Safe save on Message Thread
                         sendChangeMessage();  // Notify view to update sliders/buttons
                         continue;  // Consume message, do not update parameter
@@ -383,44 +347,59 @@ void FTMSynthAudioProcessor::processBlock(AudioBuffer<float>& buffer, MidiBuffer
         }
     }
 
+    // Share the mode budget between the voices that are currently sounding
+    // (recounted every block, voices starting or stopping during the block update it themselves)
+    voiceModeBudget.maxModes = modeBudget.load();
+    voiceModeBudget.numSoundingVoices = 0;
+    for (int i=0; i < mySynth.getNumVoices(); i++)
+    {
+        if (mySynth.getVoice(i)->isVoiceActive())
+            voiceModeBudget.numSoundingVoices++;
+    }
+
+    // Tables of the current patch, if they're ready
+    const ModeTable* modeTable = modeTablePreparer.getTable();
+
     // Retrieve parameters from sliders and pass them to the model
+    patchParamSource.read(patchParams);
     for (int i=0; i < mySynth.getNumVoices(); i++)
     {
         SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i));
         if (myVoice != nullptr)
         {
-            // this is the actual step that gets values from the tree, which are linked to the sliders
-            // IMPORTANT NOTE: the parameters need to be passed from tree.getRawParameterValue("name"),
-            //                 and NOT tree.getParameterAsValue("name").getValue(), otherwise they'll be
-            //                 applied AFTER the next note press, instead of before, which means the
-            //                 parameters will be updated one hit too late, which is what we *don't* want.
-            myVoice->getcusParam(tree.getRawParameterValue("algorithm"),
-                                 tree.getRawParameterValue("volume"),
-                                 tree.getRawParameterValue("attack"),
-                                 tree.getRawParameterValue("pitch"),
-                                 tree.getRawParameterValue("kbTrack"),
-                                 tree.getRawParameterValue("sustain"),
-                                 tree.getRawParameterValue("susGate"),
-                                 tree.getRawParameterValue("release"),
-                                 tree.getRawParameterValue("damp"),
-                                 tree.getRawParameterValue("dampGate"),
-                                 tree.getRawParameterValue("ring"),
-                                 tree.getRawParameterValue("dispersion"),
-                                 tree.getRawParameterValue("alpha2d"),
-                                 tree.getRawParameterValue("alpha3d"),
-                                 tree.getRawParameterValue("r1"),
-                                 tree.getRawParameterValue("r2"),
-                                 tree.getRawParameterValue("r3"),
-                                 tree.getRawParameterValue("m1"),
-                                 tree.getRawParameterValue("m2"),
-                                 tree.getRawParameterValue("m3"),
-                                 tree.getRawParameterValue("dimensions"));
+            // the voices only pick the values up when the snapshot's version changed
+            myVoice->setPatchParams(patchParams);
+            myVoice->setOscillatorEngine(oscillatorEngine.load());
+            myVoice->setSinglePrecision(singlePrecisionModes.load());
+            myVoice->setEnvelopeEvaluation(envelopeEvaluation.load());
+            myVoice->setModeCullThreshold(modeCullThresholdDb.load());
+            myVoice->setModeBudget(&voiceModeBudget);
+            myVoice->setSpectralModeThreshold(spectralModeThreshold.load());
+            myVoice->setMultirate(multirateModes.load());
+            myVoice->setModeTable(modeTable);
+            myVoice->setNoteTableCache(&noteTableCache);
         }
     }
 
     buffer.clear();
 
     mySynth.renderNextBlock(buffer, filteredMidi, 0, buffer.getNumSamples());
+
+    int modeCount = 0;
+    uint64_t stagesComputed = 0, stagesSkipped = 0;
+    for (int i=0; i < mySynth.getNumVoices(); i++)
+    {
+        SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i));
+        if (myVoice != nullptr)
+        {
+            modeCount += myVoice->getNumActiveModes();
+            stagesComputed += myVoice->getNumStagesComputed();
+            stagesSkipped += myVoice->getNumStagesSkipped();
+        }
+    }
+    numActiveModes.store(modeCount);
+    numStagesComputed.store(stagesComputed);
+    numStagesSkipped.store(stagesSkipped);
 }
 
 //==============================================================================
@@ -458,7 +437,116 @@ void FTMSynthAudioProcessor::setMidiLearn(const String& paramID, bool learnCC, b
 
 void FTMSynthAudioProcessor::handleAsyncUpdate()
 {
-    saveGlobalMidiMappings();
+    if (modeCapacityChanged.exchange(false))
+        reserveModes();
+
+    if (midiMappingsChanged.exchange(false))
+        saveGlobalMidiMappings();
+}
+
+//==============================================================================
+void FTMSynthAudioProcessor::parameterChanged(const String& parameterID, float /*newValue*/)
+{
+    modeTablePreparer.patchChanged();
+
+    // may be called from the audio thread (automation), so the allocation is deferred
+    if (parameterID == "m1" || parameterID == "m2" || parameterID == "m3" || parameterID == "dimensions")
+    {
+        modeCapacityChanged = true;
+        triggerAsyncUpdate();
+    }
+}
+
+void FTMSynthAudioProcessor::updateEnabledVoices()
+{
+    int deltaVoices = int(voicesParameter->load());
+    for (int i = 0; i < mySynth.getNumVoices(); i++)
+    {
+        SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i));
+        if (myVoice != nullptr && myVoice->isEnabled())
+            deltaVoices--;
+    }
+
+    if (deltaVoices > 0)
+    {
+        // Enable the first disabled voices
+        for (int i = 0; i < mySynth.getNumVoices() && deltaVoices > 0; i++)
+        {
+            SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i));
+            if (myVoice != nullptr && !myVoice->isEnabled())
+            {
+                myVoice->setEnabled(true);
+                deltaVoices--;
+            }
+        }
+    }
+    else if (deltaVoices < 0)
+    {
+        // Disable all found inactive voices starting from the end
+        int removedVoices = 0;
+        int voice = mySynth.getNumVoices()-1;
+        while (voice >= 0)
+        {
+            SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(voice));
+            if (myVoice != nullptr)
+            {
+                if (myVoice->isEnabled() && !myVoice->isVoiceActive())
+                {
+                    myVoice->setEnabled(false);
+                    removedVoices++;
+                }
+            }
+            voice--;
+
+            if (removedVoices >= (-deltaVoices)) break;
+        }
+
+        // If after a first pass, not enough voices were disabled
+        // then cut sounding ones, the next voice to steal first
+        for (int i = removedVoices; i < -deltaVoices; i++)
+        {
+            int slot = voiceAllocator.findVoiceToSteal(voiceStealing.load());
+            if (slot < 0) break;
+
+            SynthVoice* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(slot));
+            if (myVoice == nullptr) break;
+            myVoice->stopNote(0.0f, false);
+            myVoice->setEnabled(false);
+        }
+    }
+}
+
+void FTMSynthAudioProcessor::reserveModes()
+{
+    int numModes = SynthVoice::getNumModes(int(tree.getRawParameterValue("m1")->load()),
+                                           int(tree.getRawParameterValue("m2")->load()),
+                                           int(tree.getRawParameterValue("m3")->load()),
+                                           int(tree.getRawParameterValue("dimensions")->load()));
+    numModes = jmin(numModes, MAX_MODES);  // the voices shrink larger bodies, see SynthVoice::getNextPatch()
+    if (numModes <= modeCapacity)
+        return;
+
+    // allocated here, the audio thread only waits for the swaps
+    for (int i = 0; i < mySynth.getNumVoices(); i++)
+        if (auto* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+            myVoice->allocateModes(numModes);
+    NoteTableCache grownCache;
+    grownCache.allocate(numModes, size_t(FTM_DEFAULT_NOTE_TABLE_CACHE_MB) << 20);
+
+    {
+        // the voices read their tables in renderNextBlock()
+        const ScopedLock sl(getCallbackLock());
+        for (int i = 0; i < mySynth.getNumVoices(); i++)
+            if (auto* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+                myVoice->commitModes();
+        std::swap(noteTableCache, grownCache);  // the entries keep pointing into their own storage
+    }
+    modeCapacity = numModes;
+
+    // the old tables are freed outside of the lock too
+    for (int i = 0; i < mySynth.getNumVoices(); i++)
+        if (auto* myVoice = dynamic_cast<SynthVoice*>(mySynth.getVoice(i)))
+            myVoice->freeRetiredModes();
 }
 
 //==============================================================================
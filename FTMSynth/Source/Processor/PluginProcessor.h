@@ -31,6 +31,10 @@
 #include <JuceHeader.h>
 #include "SynthSound.h"
 #include "SynthVoice.h"
+#include "ModeTablePreparer.h"
+#include "NoteTableCache.h"
+#include "VoiceAllocator.h"
+#include "VoiceRenderPool.h"
 
 //==============================================================================
 struct MidiMappingEntry
@@ -75,7 +79,8 @@ static constexpr ParamInfo paramTable[] = {
 static constexpr int numMappableParams = (int)std::size(paramTable);
 
 //==============================================================================
-class FTMSynthAudioProcessor : public AudioProcessor, public ChangeBroadcaster, public AsyncUpdater
+class FTMSynthAudioProcessor : public AudioProcessor, public ChangeBroadcaster, public AsyncUpdater,
+                                public AudioProcessorValueTreeState::Listener
 {
 public:
     //==============================================================================
@@ -123,6 +128,7 @@ public:
     String learningParamID;
     void setMidiLearn(const String& paramID, bool learnCC, bool learnChannel);
     void handleAsyncUpdate() override;
+    std::atomic<bool> midiMappingsChanged { false };
 
     // Persistence
     static PropertiesFile::Options getGlobalSettingsOptions();
@@ -138,11 +144,51 @@ public:
 
     void resetAllParametersToDefault();
 
+    //==============================================================================
+    // Rendering options (not part of the saved state)
+    std::atomic<OscillatorEngine> oscillatorEngine { FTM_DEFAULT_OSCILLATOR_ENGINE };
+    std::atomic<bool> singlePrecisionModes { FTM_DEFAULT_SINGLE_PRECISION != 0 };
+    std::atomic<EnvelopeEvaluation> envelopeEvaluation { FTM_DEFAULT_ENVELOPE_EVALUATION };
+    std::atomic<float> modeCullThresholdDb { float(FTM_DEFAULT_MODE_CULL_DB) };
+    std::atomic<int> modeBudget { FTM_DEFAULT_MODE_BUDGET };  // max modes across all voices, 0 = unlimited
+    std::atomic<int> spectralModeThreshold { FTM_DEFAULT_SPECTRAL_MODE_THRESHOLD };  // 0 = oscillators only
+    std::atomic<bool> multirateModes { FTM_DEFAULT_MULTIRATE != 0 };
+    std::atomic<VoiceStealing> voiceStealing { FTM_DEFAULT_VOICE_STEALING };  // also picks the voices cut by "voices"
+    std::atomic<int> renderThreads { FTM_DEFAULT_RENDER_THREADS };  // voice rendering workers, from the next prepareToPlay()
+
+    // Number of mode oscillators rendered in the last block, across all voices
+    std::atomic<int> numActiveModes { 0 };
+
+    // Patch stages of the mode tables recomputed and skipped at note-ons, across all voices
+    std::atomic<uint64_t> numStagesComputed { 0 };
+    std::atomic<uint64_t> numStagesSkipped { 0 };
+
     //==============================================================================
     AudioProcessorValueTreeState tree;  // to link values from the slider to processor
 
 private:
-    Synthesiser mySynth;
+    // Grows the voices' mode tables to the m1/m2/m3/dimensions parameters, on the message thread,
+    // and has the patch part of the tables recomputed when any of their parameters changes
+    void parameterChanged(const String& parameterID, float newValue) override;
+    void reserveModes();
+
+    // Enables or disables voices to match the "voices" parameter (audio thread)
+    void updateEnabledVoices();
+    std::atomic<bool> modeCapacityChanged { false };
+    int modeCapacity = 0;  // modes reserved in every voice
+
+    // parameter values looked up once, the voices share the snapshot read at the start of each block
+    PatchParamSource patchParamSource { tree };
+    PatchParams patchParams;
+    std::atomic<float>* voicesParameter = tree.getRawParameterValue("voices");
+
+    ModeTablePreparer modeTablePreparer { tree };
+    NoteTableCache noteTableCache;  // shared by the voices, only touched on the audio thread once allocated
+
+    VoiceAllocator voiceAllocator;  // declared before mySynth, which reads it
+    VoiceRenderPool voiceRenderPool;
+    StealingSynthesiser mySynth { voiceAllocator };
+    ModeBudget voiceModeBudget;  // shared by the voices, also from the render pool's threads (atomic count)
 
     double lastSampleRate;
 
@@ -0,0 +1,194 @@
+/*
+  ==============================================================================
+
+    SpectralModeBank.cpp
+    Created: 17 Oct 2026 11:37:37am
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "SpectralModeBank.h"
+#include "ModeBank.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// 4-term Blackman-Harris window, centred on n = 0 (zero-phase)
+static double blackmanHarris(int n)
+{
+    double x = 2.0 * M_PI * n / SpectralModeBank::fftSize;
+    return 0.35875 + 0.48829 * cos(x) + 0.14128 * cos(2.0*x) + 0.01168 * cos(3.0*x);
+}
+
+
+//==================================
+void SpectralModeBank::computeKernel()
+{
+    const int halfSize = fftSize / 2;
+    double window[fftSize];
+    for (int n = -halfSize; n < halfSize; n++)
+        window[n + halfSize] = blackmanHarris(n);
+
+    // DTFT of the window, sampled every 1/kernelOversampling bin over [-(K+1), K+1]
+    const int numPoints = int(sizeof(kernel) / sizeof(kernel[0]));
+    for (int j = 0; j < numPoints; j++)
+    {
+        double x = double(j) / kernelOversampling - (kernelHalfWidth + 1);
+        double sum = 0.0;
+        for (int n = -halfSize; n < halfSize; n++)
+            sum += window[n + halfSize] * cos(2.0 * M_PI * x * n / fftSize);
+        kernel[j] = float(sum);
+    }
+
+    // the triangles of consecutive frames sum to one
+    for (int k = 0; k < 2*hopSize; k++)
+    {
+        int n = k - hopSize;
+        frameWeights[k] = float((1.0 - abs(n) / double(hopSize)) / window[n + halfSize]);
+    }
+}
+
+float SpectralModeBank::getKernel(double x)
+{
+    double position = (x + (kernelHalfWidth + 1)) * kernelOversampling;
+    int index = int(position);
+    float frac = float(position - index);
+    return kernel[index] + frac * (kernel[index + 1] - kernel[index]);
+}
+
+bool SpectralModeBank::isSlowEnough(double decay)
+{
+    return ModeBank::integerPower(decay, hopSize) >= minHopDecay;
+}
+
+
+//==================================
+SpectralModeBank::SpectralModeBank()
+    : fft(fftOrder),
+      spectrum(2 * fftSize),
+      ready(hopSize),
+      pending(hopSize)
+{
+}
+
+void SpectralModeBank::reset()
+{
+    readPosition = hopSize;
+    started = false;
+}
+
+void SpectralModeBank::render(const double* sinTable, int sinTableShift,
+                              const uint32_t* phases, const uint32_t* increments,
+                              const double* gains, const double* decays, const double* envStates,
+                              size_t numModes, double* output, int numSamples)
+{
+    int s = 0;
+    while (s < numSamples)
+    {
+        if (readPosition == hopSize)
+        {
+            // a new stream begins with a frame centred on its first sample
+            if (!started)
+                synthesizeFrame(sinTable, sinTableShift, phases, increments, gains, decays, envStates,
+                                numModes, s);
+
+            synthesizeFrame(sinTable, sinTableShift, phases, increments, gains, decays, envStates,
+                            numModes, s + hopSize);
+        }
+
+        int n = std::min(numSamples - s, hopSize - readPosition);
+        for (int k = 0; k < n; k++)
+            output[s + k] += ready[readPosition + k];
+
+        s += n;
+        readPosition += n;
+    }
+}
+
+void SpectralModeBank::synthesizeFrame(const double* sinTable, int sinTableShift,
+                                       const uint32_t* phases, const uint32_t* increments,
+                                       const double* gains, const double* decays, const double* envStates,
+                                       size_t numModes, int offset)
+{
+    std::fill(spectrum.begin(), spectrum.end(), 0.0f);
+
+    const double binsPerIncrement = fftSize / 4294967296.0;
+    const int lastBin = fftSize / 2;
+
+    for (size_t i = 0; i < numModes; i++)
+    {
+        // frozen (above Nyquist) modes have a zero gain
+        double amp = gains[i] * envStates[i] * ModeBank::integerPower(decays[i], offset);
+        if (amp == 0.0) continue;
+
+        // mode state at the centre of the frame
+        uint32_t phase = phases[i] + increments[i] * static_cast<uint32_t>(offset);
+        double sinPhase = sinTable[phase >> sinTableShift];
+        double cosPhase = sinTable[static_cast<uint32_t>(phase + 0x40000000u) >> sinTableShift];
+
+        // amp * sin(phase + w*n) = amp/2i * (e^(i(phase + w*n)) - e^(-i(phase + w*n)))
+        float re = float(0.5 * amp * sinPhase);
+        float im = float(-0.5 * amp * cosPhase);
+
+        double frequency = increments[i] * binsPerIncrement;  // in bins
+        int centre = int(frequency);
+
+        // consecutive bins are kernelOversampling entries apart in the table, with the same fraction
+        int first = std::max(0, centre - kernelHalfWidth + 1);
+        int last = std::min(lastBin, centre + kernelHalfWidth);
+        double position = (first - frequency + (kernelHalfWidth + 1)) * kernelOversampling;
+        int index = int(position);
+        float frac = float(position - index);
+        for (int k = first; k <= last; k++, index += kernelOversampling)
+        {
+            float w = kernel[index] + frac * (kernel[index + 1] - kernel[index]);
+            spectrum[2*k] += w * re;
+            spectrum[2*k + 1] += w * im;
+        }
+
+        // the negative-frequency lobe of low modes reaches the first bins
+        for (int k = 0; k < kernelHalfWidth - frequency; k++)
+        {
+            float w = getKernel(k + frequency);
+            spectrum[2*k] += w * re;
+            spectrum[2*k + 1] -= w * im;
+        }
+    }
+
+    fft.performRealOnlyInverseTransform(spectrum.data());
+
+    // the frame is zero-phase: sample n of the frame is at spectrum[n mod fftSize]
+    if (!started)
+    {
+        for (int k = 0; k < hopSize; k++)
+            pending[k] = spectrum[k] * frameWeights[hopSize + k];
+        started = true;
+        return;
+    }
+
+    for (int k = 0; k < hopSize; k++)
+    {
+        ready[k] = pending[k] + spectrum[fftSize - hopSize + k] * frameWeights[k];
+        pending[k] = spectrum[k] * frameWeights[hopSize + k];
+    }
+    readPosition = 0;
+}
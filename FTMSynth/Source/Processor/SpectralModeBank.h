@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    SpectralModeBank.h
+    Created: 17 Oct 2026 11:37:37am
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <JuceHeader.h>
+
+
+// Inverse-FFT additive synthesis of the same decaying sines as ModeBank::render().
+//
+// Every hopSize samples, each mode adds the spectrum of a windowed stationary sine (2*kernelHalfWidth
+// bins of the Blackman-Harris window transform, centred on its frequency) to a single spectrum,
+// which one inverse FFT turns into a frame. Frames are centred hopSize samples apart and
+// overlap-added with a triangular window (after dividing out the Blackman-Harris one), so each
+// mode's amplitude is linearly interpolated between two frames. The cost per hop is O(numModes
+// * kernelHalfWidth) plus one FFT, instead of O(numModes * hopSize) for the oscillators.
+//
+// The linear amplitude interpolation is only accurate for modes decaying slowly over a hop,
+// see isSlowEnough(). Relative to the voice's peak, the error is around -82 to -87 dB with
+// Selesnick's algorithm and down to -72 dB with Rabenstein's (see SynthVoiceTests).
+class SpectralModeBank
+{
+public:
+    static constexpr int fftOrder = 10;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int hopSize = fftSize / 4;   // the triangle covers the middle half of a frame
+    static constexpr int kernelHalfWidth = 4;     // main lobe of the 4-term Blackman-Harris window
+    static constexpr int kernelOversampling = 256;
+
+    static constexpr double minHopDecay = 0.9;    // envelope ratio over a hop for isSlowEnough()
+
+    // Fills the window tables, to be called once before any rendering (like SynthVoice::computeSinLUT)
+    static void computeKernel();
+
+    // True if a mode with this per-sample decay can be rendered here
+    static bool isSlowEnough(double decay);
+
+    SpectralModeBank();
+
+    // Starts a new overlap-add stream at the next render(), dropping the pending frame halves.
+    // Needed whenever modes join or leave the bank.
+    void reset();
+
+    // Adds the modes [0, numModes) to output[0 .. numSamples). The states are the ones at the first
+    // sample of the block, and are NOT advanced (the caller does it once per block).
+    // sinTable is the same truncated table as for ModeBank::render().
+    void render(const double* sinTable, int sinTableShift,
+                const uint32_t* phases, const uint32_t* increments,
+                const double* gains, const double* decays, const double* envStates,
+                size_t numModes, double* output, int numSamples);
+
+private:
+    // Synthesises the frame centred offset samples after the beginning of the block
+    void synthesizeFrame(const double* sinTable, int sinTableShift,
+                         const uint32_t* phases, const uint32_t* increments,
+                         const double* gains, const double* decays, const double* envStates,
+                         size_t numModes, int offset);
+
+    // Blackman-Harris transform at x bins from its centre (real, as the window is symmetric)
+    static float getKernel(double x);
+
+    inline static float kernel[2 * (kernelHalfWidth + 1) * kernelOversampling + 1];
+    inline static float frameWeights[2 * hopSize];  // triangle / window over [-hopSize, hopSize)
+
+    dsp::FFT fft;
+    std::vector<float> spectrum;  // 2*fftSize floats, interleaved complex bins then the frame
+    std::vector<float> ready;     // finished samples of the current hop
+    std::vector<float> pending;   // second half of the last frame, completed by the next one
+    int readPosition = hopSize;
+    bool started = false;
+};
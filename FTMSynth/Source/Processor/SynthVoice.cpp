@@ -26,16 +26,52 @@
 */
 
 #include "SynthVoice.h"
+#include "NoteTableCache.h"
+#include "VoiceAllocator.h"
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 
 using namespace std;
 
+// octave band a mode is rendered in by the multirate path (band b runs at sr / 2^b),
+// keeping a full octave of headroom for pitch bends
+static int getOctaveBand(uint32_t increment)
+{
+    double bandEdge = BandUpsampler::passbandEdge * 4294967296.0 * 0.5;  // band 1, in full-rate increments
+    int band = 0;
+    while (band + 1 < BandUpsampler::maxBands && 2.0 * increment <= bandEdge)
+    {
+        band++;
+        bandEdge *= 0.5;
+    }
+    return band;
+}
+
+
+SynthVoice::SynthVoice()
+{
+    // enough for the default sizes, the processor grows it to the actual parameters
+    reserveModes(getNumModes(m1, m2, m3, 3));
+}
 
 bool SynthVoice::canPlaySound(SynthesiserSound* sound)
 {
     // if succesfully cast sound into my own class, return true
-    return dynamic_cast<SynthSound*>(sound) != nullptr;
+    return enabled && dynamic_cast<SynthSound*>(sound) != nullptr;
+}
+
+void SynthVoice::setEnabled(bool shouldBeEnabled)
+{
+    enabled = shouldBeEnabled;
+    if (voiceAllocator != nullptr)
+        voiceAllocator->setEnabled(voiceSlot, enabled);
+}
+
+bool SynthVoice::isEnabled() const
+{
+    return enabled;
 }
 
 
@@ -45,63 +81,71 @@ void SynthVoice::computeSinLUT()
     for (int i = 0; i < SIN_LUT_RESOLUTION; i++)
     {
         sinLUT[i] = sin(i * 2.0 * M_PI / SIN_LUT_RESOLUTION);
+        sinLUTf[i] = float(sinLUT[i]);
     }
-}
 
+    const int compactSize = 1 << COMPACT_SIN_LUT_BITS;
+    for (int i = 0; i <= compactSize; i++)
+    {
+        compactSinLUT[i] = float(sin(i * 2.0 * M_PI / compactSize));
+    }
 
-// some function that grabs value from the slider, and then either returns or set the signal of my synthesized drum sound
-// IMPORTANT NOTE: the parameters need to be passed as std::atomic<float>*, from tree.getRawParameterValue("name"),
-//                 otherwise they'll be applied AFTER the next note press, instead of before, which means the
-//                 parameters will be updated one hit too late, which is *not* what we want.
-void SynthVoice::getcusParam(std::atomic<float>* algo,
-                             std::atomic<float>* volume,
-                             std::atomic<float>* attack,
-                             std::atomic<float>* pitch,
-                             std::atomic<float>* kbTrack,
-                             std::atomic<float>* _tau,
-                             std::atomic<float>* gate,
-                             std::atomic<float>* rel,
-                             std::atomic<float>* p,
-                             std::atomic<float>* pGate,
-                             std::atomic<float>* ring,
-                             std::atomic<float>* dispersion,
-                             std::atomic<float>* alpha1,
-                             std::atomic<float>* alpha2,
-                             std::atomic<float>* x,
-                             std::atomic<float>* y,
-                             std::atomic<float>* z,
-                             std::atomic<float>* modesX,
-                             std::atomic<float>* modesY,
-                             std::atomic<float>* modesZ,
-                             std::atomic<float>* dimensions)
-{
-    // this function fetches parameters from the customized GUI and calculates the
-    // corresponding parameters in order to synthesize the sound
-    nextAlgorithm = ((int(algo->load()) >= 1) ? Algorithm::rabenstein : Algorithm::selesnick);
-    mainVolume = volume->load();
-    nextAtk = attack->load();
+    excitationSin[0] = 0;
+    getSineSequence(M_PI / tau, 2*tau - 1, excitationSin + 1);
+}
 
-    fpitch = pitch->load();
-    bkbTrack = (kbTrack->load() >= 0.5f);
-    ftau = _tau->load();
-    bgate = (gate->load() >= 0.5f);
-    frel = rel->load();
-    fp = p->load();
-    bpGate = (pGate->load() >= 0.5f);
-    fring = ring->load();
-    nextd = dispersion->load();
-    nexta = alpha1->load();
-    nexta2 = alpha2->load();
+// output[n] = sin((n+1)*theta) for n in [0, count), by angle addition: one sin() and one cos()
+// for the whole sequence, then four multiplies per term. The rounding error only grows
+// linearly with n, it stays below 1e-13 over 2*tau terms.
+void SynthVoice::getSineSequence(double theta, int count, double* output)
+{
+    double c1 = cos(theta);
+    double s1 = sin(theta);
+    double c = c1;
+    double s = s1;
+    for (int n = 0; n < count; n++)
+    {
+        output[n] = s;
+        double next = s*c1 + c*s1;
+        c = c*c1 - s*s1;
+        s = next;
+    }
+}
 
-    r1 = x->load();
-    r2 = y->load();
-    r3 = z->load();
 
-    nextm1 = int(modesX->load());
-    nextm2 = int(modesY->load());
-    nextm3 = int(modesZ->load());
+// copies the processor's parameter snapshot, unless this voice already has that version of it
+void SynthVoice::setPatchParams(const PatchParams& params)
+{
+    if (params.version == patchParamsVersion) return;
+    patchParamsVersion = params.version;
 
-    nextDim = int(dimensions->load()) - 1;
+    // this function fetches parameters from the customized GUI and calculates the
+    // corresponding parameters in order to synthesize the sound
+    nextAlgorithm = ((int(params.algorithm) >= 1) ? Algorithm::rabenstein : Algorithm::selesnick);
+    mainVolume = params.volume;
+    nextAtk = params.attack;
+
+    fpitch = params.pitch;
+    bkbTrack = (params.kbTrack >= 0.5f);
+    ftau = params.sustain;
+    bgate = (params.susGate >= 0.5f);
+    frel = params.release;
+    fp = params.damp;
+    bpGate = (params.dampGate >= 0.5f);
+    fring = params.ring;
+    nextd = params.dispersion;
+    nexta = params.alpha2d;
+    nexta2 = params.alpha3d;
+
+    r1 = params.r1;
+    r2 = params.r2;
+    r3 = params.r3;
+
+    nextm1 = int(params.m1);
+    nextm2 = int(params.m2);
+    nextm3 = int(params.m3);
+
+    nextDim = int(params.dimensions) - 1;
 }
 
 
@@ -141,594 +185,1598 @@ void SynthVoice::selesnick_deff()
 // get coefficients of the integral f1m1 using trapezoid rule
 void SynthVoice::selesnick_getf()
 {
-    // integrate f(x)sin(mpix/l)dx from 0 to l using trapezoid rule
-    double integ;
-
     // 1D
-    if (dim >= 0)
+    if (dim >= 0) selesnick_project(fx1, m1, f1);
+    // 2D
+    if (dim >= 1) selesnick_project(fx2, m2, f2);
+    // 3D
+    if (dim >= 2) selesnick_project(fx3, m3, f3);
+}
+
+// integrate f(x)sin(mpix/l)dx from 0 to l with the trapezoid rule over the tau+1 samples of fx.
+// The sine at sample i of mode j+1 is sin(i*(j+1)*pi/tau) whatever the length, so it's read from
+// excitationSin instead of being computed for every sample of every mode.
+void SynthVoice::selesnick_project(const double* fx, int m, double* f)
+{
+    for (int j=0; j<m; j++)
     {
-        double l = M_PI;
-        int m = m1;
-        double h = l / tau;
-        for (int j=0; j<m; j++)
+        // the end points are on the nodes of the sine, only the interior samples count
+        double integ = 0;
+        int n = 0;
+        for (int i=1; i<tau; i++)
         {
-            integ = 0;
-            for (int i=0; i<tau; i++)
-            {
-                integ += (fx1[i+1]*sin((i+1)*h*M_PI*(j+1)/l) + fx1[i]*sin(i*h*M_PI*(j+1)/l))*h/2.0;  // (f(b)+f(a))*(b-a)/2
-            }
-            f1[j] = 2*integ/l;
+            n += j+1;
+            if (n >= 2*tau) n -= 2*tau;
+            integ += fx[i] * excitationSin[n];
         }
+        f[j] = 2*integ/tau;  // 2/l * integ * h
     }
+}
+
+// intermediate variables
+// sigma
+void SynthVoice::selesnick_getSigma(double _tau, double p)
+{
+    double fsigma = -1/_tau;
+    double fbeta = selesnick_getAxisTables(_tau, p);
+
+    int maxIndex = getNumModes();
+    outerSum(axisTerm1, axisTerm2, axisTerm3, sigma.data());
+    for (int i=0; i<maxIndex; i++)
+        sigma[i] = fsigma*(1+p*(sigma[i]-fbeta));
+    outerProduct(axisDecay1, axisDecay2, axisDecay3, decayamp.data());
+}
+
+// the per-axis terms and decay factors of sigma, returns beta
+double SynthVoice::selesnick_getAxisTables(double _tau, double p)
+{
+    double fsigma = -1/_tau;
+    double fbeta = 1;
+
+    // sigma and omega only depend on the squared mode numbers weighted along each axis
+    for (int i=0; i<m1; i++) axisTerm1[i] = pow(i+1,2);
+    axisTerm2[0] = 0;
+    axisTerm3[0] = 0;
+
     // 2D
+    if (dim == 1)
+    {
+        fbeta = fa + 1/fa;
+        for (int i=0; i<m1; i++) axisTerm1[i] = pow(i+1,2)*fa;
+        for (int j=0; j<m2; j++) axisTerm2[j] = pow(j+1,2)/fa;
+    }
+    // 3D
+    else if (dim == 2)
+    {
+        fbeta = fa*fa2 + fa/fa2 + fa2/fa;
+        for (int i=0; i<m1; i++) axisTerm1[i] = pow(i+1,2)*fa*fa2;
+        for (int j=0; j<m2; j++) axisTerm2[j] = pow(j+1,2)*fa2/fa;
+        for (int k=0; k<m3; k++) axisTerm3[k] = pow(k+1,2)*fa/fa2;
+    }
+
+    // exp(sigma/sr) splits into one factor per axis, the constant part going to the first one
+    double decay0 = exp(fsigma*(1-p*fbeta)/sr);
+    for (int i=0; i<m1; i++) axisDecay1[i] = decay0 * exp(fsigma*p*axisTerm1[i]/sr);
+    for (int j=0; j<getAxisSize(2); j++) axisDecay2[j] = exp(fsigma*p*axisTerm2[j]/sr);
+    for (int k=0; k<getAxisSize(3); k++) axisDecay3[k] = exp(fsigma*p*axisTerm3[k]/sr);
+
+    return fbeta;
+}
+
+// get the terms of coefficient omega for the impulse response, omega^2 = fomega^2 * omegaScale + omegaOffset
+void SynthVoice::selesnick_getwTerms(double p)
+{
+    // the axis terms are the ones of the last selesnick_getSigma()
+    double fbeta = 1;
+    if (dim == 1) fbeta = fa + 1/fa;
+    else if (dim == 2) fbeta = fa*fa2 + fa/fa2 + fa2/fa;
+    double fsigma = -1/ftau;
+
+    // omega^2 = (fd*fomega)^2*M^4 + M^2*(b + fomega^2*b') - c, M^2 being the weighted sum of the squared mode numbers
+    double b = pow(fsigma*(1-p*fbeta), 2)/fbeta;
+    double bScale = (1-pow(fd*fbeta, 2))/fbeta;
+    double c = pow(fsigma*(1-p*fbeta), 2);
+
+    int maxIndex = getNumModes();
+    outerSum(axisTerm1, axisTerm2, axisTerm3, omegaOffset.data());
+    for (int i=0; i<maxIndex; i++)
+    {
+        double interm = omegaOffset[i];  // M^2
+        omegaScale[i] = fd*fd*interm*interm + interm*bScale;
+        omegaOffset[i] = interm*b - c;
+    }
+}
+
+// get coefficient k for the impulse response, times omega
+void SynthVoice::selesnick_getKTerms()
+{
+    double l1 = M_PI;
+    double x1 = l1*r1;
+
+    // excitation times pickup along each axis
+    getSineSequence(x1*M_PI/l1, m1, axisGain1);
+    for (int i=0; i<m1; i++) axisGain1[i] *= f1[i];
+    axisGain2[0] = 1;
+    axisGain3[0] = 1;
+
     if (dim >= 1)
     {
-        double l = fa*M_PI;
-        int m = m2;
-        double h = l / tau;
-        for (int j=0; j<m; j++)
+        double l2 = fa*M_PI;
+        double x2 = l2*r2;
+        getSineSequence(x2*M_PI/l2, m2, axisGain2);
+        for (int j=0; j<m2; j++) axisGain2[j] *= f2[j];
+    }
+    if (dim >= 2)
+    {
+        double l3 = fa2*M_PI;
+        double x3 = l3*r3;
+        getSineSequence(x3*M_PI/l3, m3, axisGain3);
+        for (int k=0; k<m3; k++) axisGain3[k] *= f3[k];
+    }
+
+    outerProduct(axisGain1, axisGain2, axisGain3, modeGain.data());
+}
+
+
+void SynthVoice::rabenstein_getCoefficients(double _tau, double p)
+{
+    double d1, d3;
+    rabenstein_getAxisTables(_tau, p, d1, d3);
+
+    int maxIndex = getNumModes();
+    outerSum(axisTerm1, axisTerm2, axisTerm3, alpha.data());
+    for (int i=0; i<maxIndex; i++)
+        alpha[i] = (d1 - d3 * alpha[i]) / 2;
+    outerProduct(axisDecay1, axisDecay2, axisDecay3, decayamp.data());
+}
+
+// the per-axis wave numbers and decay factors, and fN, alpha = (d1 - d3 * n) / 2
+void SynthVoice::rabenstein_getAxisTables(double _tau, double p, double& d1, double& d3)
+{
+    double l0 = M_PI;  // constant
+    double area = 1;   // product of the aspect ratios
+    double fbeta = 1;
+
+    // squared wave numbers along each axis
+    for (int i=0; i<m1; i++) axisTerm1[i] = pow(i+1, 2);
+    axisTerm2[0] = 0;
+    axisTerm3[0] = 0;
+    fN = M_PI / 4;
+
+    // 2D
+    if (dim == 1)
+    {
+        double l2 = M_PI*fa;
+        area = fa;
+        fbeta = fa + 1/fa;
+        for (int i=0; i<m1; i++) axisTerm1[i] = pow((i+1)*M_PI/l0, 2);
+        for (int j=0; j<m2; j++) axisTerm2[j] = pow((j+1)*M_PI/l2, 2);
+        fN = M_PI * l2 / 4;
+    }
+    // 3D
+    else if (dim == 2)
+    {
+        double l2 = M_PI*fa;
+        double l3 = M_PI*fa2;
+        area = fa*fa2;
+        fbeta = fa*fa2 + fa/fa2 + fa2/fa;
+        for (int i=0; i<m1; i++) axisTerm1[i] = pow((i+1)*M_PI/l0, 2);
+        for (int j=0; j<m2; j++) axisTerm2[j] = pow((j+1)*M_PI/l2, 2);
+        for (int k=0; k<m3; k++) axisTerm3[k] = pow((k+1)*M_PI/l3, 2);
+        fN = M_PI * l2 * l3 / 8;
+    }
+
+    d1 = 2 * (1 - p*fbeta) / _tau;
+    d3 = -2 * p * area / _tau;
+
+    // alpha is affine in the summed wave numbers, so exp(-alpha/sr) splits into one factor per axis
+    double decay0 = exp(-d1/2/sr);
+    for (int i=0; i<m1; i++) axisDecay1[i] = decay0 * exp(d3*axisTerm1[i]/2/sr);
+    for (int j=0; j<getAxisSize(2); j++) axisDecay2[j] = exp(d3*axisTerm2[j]/2/sr);
+    for (int k=0; k<getAxisSize(3); k++) axisDecay3[k] = exp(d3*axisTerm3[k]/2/sr);
+}
+
+// get the terms of coefficient omega, omega^2 = fomega^2 * omegaScale + omegaOffset
+void SynthVoice::rabenstein_getwTerms(double _tau, double p)
+{
+    // the axis terms and alpha are the ones of the last rabenstein_getCoefficients()
+    double area = 1;
+    double fbeta = 1;
+    if (dim == 1)
+    {
+        area = fa;
+        fbeta = fa + 1/fa;
+    }
+    else if (dim == 2)
+    {
+        area = fa*fa2;
+        fbeta = fa*fa2 + fa/fa2 + fa2/fa;
+    }
+
+    // beta = EI * n^2 + T * n, split into what scales with fomega^2 and what doesn't
+    double EIScale = pow(fd*area, 2);
+    double EIOffset = pow(p*area/_tau, 2);
+    double TScale = area * (1/fbeta - fd*fd * fbeta);
+    double TOffset = area * (1/fbeta - p*p*fbeta) / _tau*_tau;
+
+    int maxIndex = getNumModes();
+    outerSum(axisTerm1, axisTerm2, axisTerm3, omegaOffset.data());
+    for (int i=0; i<maxIndex; i++)
+    {
+        double n = omegaOffset[i];
+
+        // omega^2 = beta - alpha^2
+        omegaScale[i] = EIScale * n*n + TScale * n;
+        omegaOffset[i] = EIOffset * n*n + TOffset * n - alpha[i]*alpha[i];
+    }
+}
+
+// get coefficient k for the impulse response
+void SynthVoice::rabenstein_getKTerms()
+{
+    // pickup position along each axis
+    getSineSequence(M_PI*r1, m1, axisGain1);
+    axisGain2[0] = 1;
+    axisGain3[0] = 1;
+    if (dim >= 1) getSineSequence(M_PI*r2, m2, axisGain2);
+    if (dim >= 2) getSineSequence(M_PI*r3, m3, axisGain3);
+
+    outerProduct(axisGain1, axisGain2, axisGain3, modeGain.data());
+}
+
+
+// get coefficient omega for the impulse response, from the terms of the patch and the note's fomega
+void SynthVoice::getw()
+{
+    int maxIndex = getNumModes();
+    double fomega2 = fomega*fomega;
+
+    if (currentAlgorithm == Algorithm::rabenstein)
+    {
+        for (int i=0; i<maxIndex; i++)
         {
-            integ = 0;
-            for (int i=0; i<tau; i++)
-            {
-                integ += (fx2[i+1]*sin((i+1)*h*M_PI*(j+1)/l) + fx2[i]*sin(i*h*M_PI*(j+1)/l))*h/2.0;  // (f(b)+f(a))*(b-a)/2
-            }
-            f2[j] = 2*integ/l;
+            omega[i] = sqrt(abs(fomega2*omegaScale[i] + omegaOffset[i]));
+            mode_rejected[i] = ((omega[i]/(2*M_PI)) > (sr/2));
         }
     }
-    // 3D
-    if (dim >= 2)
+    else
     {
-        double l = fa2*M_PI;
-        int m = m3;
-        double h = l / tau;
-        for (int j=0; j<m; j++)
+        for (int i=0; i<maxIndex; i++)
         {
-            integ = 0;
-            for (int i=0; i<tau; i++)
-            {
-                integ += (fx3[i+1]*sin((i+1)*h*M_PI*(j+1)/l) + fx3[i]*sin(i*h*M_PI*(j+1)/l))*h/2.0;  // (f(b)+f(a))*(b-a)/2
-            }
-            f3[j] = 2*integ/l;
+            omega[i] = sqrt(fomega2*omegaScale[i] + omegaOffset[i]);
+
+            // remove aliasing by checking whether the mode frequency is above Nyquist
+            mode_rejected[i] = ((omega[i]/(2*M_PI)) >= (sr/2));
         }
     }
 }
 
-// intermediate variables
-// sigma
-void SynthVoice::selesnick_getSigma(double _tau, double p)
+// get coefficients k (and y) for the impulse response
+void SynthVoice::getK()
 {
-    double fsigma = -1/_tau;
+    int maxIndex = getNumModes();
 
-    // 1D
-    if (dim == 0)
+    if (currentAlgorithm == Algorithm::rabenstein)
     {
-        for (int i=0; i<m1; i++)
+        for (int i=0; i<maxIndex; i++)
         {
-            sigma[i] = fsigma*(1+p*(pow(i+1,2)-1));
-            decayamp[i] = exp(sigma[i]/sr);
+            knd[i] = modeGain[i];
+            yi[i] = level * knd[i] / omega[i];
         }
     }
-    // 2D
-    else if (dim == 1)
+    else
+    {
+        for (int i=0; i<maxIndex; i++)
+            knd[i] = modeGain[i] / omega[i];
+    }
+}
+
+// mode tables are laid out as [i + m1*(j + m2*k)], one entry along the unused axes
+int SynthVoice::getAxisSize(int axis) const
+{
+    if (axis == 1) return m1;
+    if (axis == 2) return (dim >= 1 ? m2 : 1);
+    return (dim >= 2 ? m3 : 1);
+}
+
+void SynthVoice::outerSum(const double* a1, const double* a2, const double* a3, double* output) const
+{
+    int n1 = getAxisSize(1), n2 = getAxisSize(2), n3 = getAxisSize(3);
+    for (int k=0; k<n3; k++)
     {
-        double fbeta = fa + 1/fa;
-        for (int j=0; j<m2; j++)
+        for (int j=0; j<n2; j++)
         {
-            for (int i=0; i<m1; i++)
-            {
-                sigma[i+m1*j] = fsigma*(1+p*(pow(i+1,2)*fa+pow(j+1,2)/fa-fbeta));
-                decayamp[i+m1*j] = exp(sigma[i+m1*j]/sr);
-            }
+            double a23 = a2[j] + a3[k];
+            double* row = output + n1*(j + n2*k);
+            for (int i=0; i<n1; i++)
+                row[i] = a1[i] + a23;
         }
     }
-    // 3D
-    else if (dim == 2)
+}
+
+void SynthVoice::outerProduct(const double* a1, const double* a2, const double* a3, double* output) const
+{
+    int n1 = getAxisSize(1), n2 = getAxisSize(2), n3 = getAxisSize(3);
+    for (int k=0; k<n3; k++)
     {
-        double fbeta = fa*fa2 + fa/fa2 + fa2/fa;
-        for (int k=0; k<m3; k++)
+        for (int j=0; j<n2; j++)
         {
-            for (int j=0; j<m2; j++)
+            double a23 = a2[j] * a3[k];
+            double* row = output + n1*(j + n2*k);
+            for (int i=0; i<n1; i++)
+                row[i] = a1[i] * a23;
+        }
+    }
+}
+
+
+//==================================
+ModeTable::Patch SynthVoice::getNextPatch(double sampleRate) const
+{
+    ModeTable::Patch patch;
+    patch.algorithm = nextAlgorithm;
+    patch.dim = nextDim;
+    patch.m1 = nextm1;
+    patch.m2 = nextm2;
+    patch.m3 = nextm3;
+    patch.d = nextd;
+    patch.a = nexta;
+    patch.a2 = nexta2;
+    patch.r1 = r1;
+    patch.r2 = r2;
+    patch.r3 = r3;
+    patch.tau = ftau;
+    patch.p = fp;
+    patch.sampleRate = sampleRate;
+    shrinkToFit(patch, MAX_MODES);
+    return patch;
+}
+
+void SynthVoice::shrinkToFit(ModeTable::Patch& patch, int maxModes)
+{
+    while (getNumModes(patch.m1, patch.m2, patch.m3, patch.dim + 1) > maxModes)
+    {
+        int* largest = &patch.m1;
+        if (patch.dim >= 1 && patch.m2 > *largest) largest = &patch.m2;
+        if (patch.dim >= 2 && patch.m3 > *largest) largest = &patch.m3;
+        (*largest)--;
+    }
+}
+
+void SynthVoice::applyPatch(const ModeTable::Patch& patch)
+{
+    currentAlgorithm = patch.algorithm;
+    dim = patch.dim;
+    m1 = patch.m1;
+    m2 = patch.m2;
+    m3 = patch.m3;
+    fd = patch.d;
+    fa = patch.a;
+    fa2 = patch.a2;
+    r1 = patch.r1;
+    r2 = patch.r2;
+    r3 = patch.r3;
+    ftau = patch.tau;
+    fp = patch.p;
+    sr = patch.sampleRate;
+}
+
+// Which stages of the patch tables depend on the patch fields that differ, by APVTS parameter:
+//   algorithm, m1/m2/m3, dimensions, alpha2d, alpha3d -> everything (the mode layout and axis terms)
+//   r1/r2/r3     -> excitation, gain
+//   sustain, damp -> damping, frequency
+//   dispersion   -> frequency
+//   sample rate  -> damping (decayamp only)
+// release and ring aren't part of the patch, they only change the decays of a released note
+uint32_t SynthVoice::getChangedStages(const ModeTable::Patch& from, const ModeTable::Patch& to)
+{
+    uint32_t changed = 0;
+    if (from.algorithm != to.algorithm || from.dim != to.dim
+        || from.m1 != to.m1 || from.m2 != to.m2 || from.m3 != to.m3
+        || from.a != to.a || from.a2 != to.a2)
+        changed |= allStages;
+    if (from.r1 != to.r1 || from.r2 != to.r2 || from.r3 != to.r3)
+        changed |= excitationStage | gainStage;
+    if (from.tau != to.tau || from.p != to.p)
+        changed |= dampingStage | frequencyStage;
+    if (from.d != to.d)
+        changed |= frequencyStage;
+    if (from.sampleRate != to.sampleRate)
+        changed |= dampingStage;
+    return changed;
+}
+
+// the part of the mode tables that doesn't depend on the note (pitch and velocity),
+// only recomputing the stages whose inputs changed since they were last computed
+void SynthVoice::computePatchTables(const ModeTable::Patch& patch)
+{
+    uint32_t dirty = (allStages & ~validStages) | getChangedStages(computedPatch, patch);
+    uint32_t used = allStages;
+
+    if (currentAlgorithm == Algorithm::selesnick)
+    {
+        if (dirty & excitationStage)
+        {
+            selesnick_deff();
+            selesnick_getf();
+        }
+        if (dirty & dampingStage) selesnick_getSigma(ftau, fp);
+        if (dirty & frequencyStage) selesnick_getwTerms(fp);
+        if (dirty & gainStage) selesnick_getKTerms();
+    }
+    else if (currentAlgorithm == Algorithm::rabenstein)
+    {
+        used &= ~excitationStage;
+        if (dirty & dampingStage) rabenstein_getCoefficients(ftau, fp);
+        if (dirty & frequencyStage) rabenstein_getwTerms(ftau, fp);
+        if (dirty & gainStage) rabenstein_getKTerms();
+    }
+
+    int numComputed = 0, numUsed = 0;
+    for (uint32_t stage = 1; stage & allStages; stage <<= 1)
+    {
+        numUsed += (used & stage) ? 1 : 0;
+        numComputed += (used & dirty & stage) ? 1 : 0;
+    }
+    numStagesComputed += uint64_t(numComputed);
+    numStagesSkipped += uint64_t(numUsed - numComputed);
+
+    computedPatch = patch;
+    validStages = allStages;
+}
+
+void SynthVoice::computeModeTable(const ModeTable::Patch& patch, ModeTable& table)
+{
+    applyPatch(patch);
+    reserveModes(getNumModes());
+    computePatchTables(patch);
+
+    int numModes = getNumModes();
+    table.patch = patch;
+    if (currentAlgorithm == Algorithm::rabenstein)
+        table.damping.assign(alpha.begin(), alpha.begin() + numModes);
+    else
+        table.damping.assign(sigma.begin(), sigma.begin() + numModes);
+    table.decayamp.assign(decayamp.begin(), decayamp.begin() + numModes);
+    table.omegaScale.assign(omegaScale.begin(), omegaScale.begin() + numModes);
+    table.omegaOffset.assign(omegaOffset.begin(), omegaOffset.begin() + numModes);
+    table.modeGain.assign(modeGain.begin(), modeGain.begin() + numModes);
+    table.fN = fN;
+}
+
+void SynthVoice::loadModeTable(const ModeTable& table)
+{
+    if (currentAlgorithm == Algorithm::rabenstein)
+        std::copy(table.damping.begin(), table.damping.end(), alpha.begin());
+    else
+        std::copy(table.damping.begin(), table.damping.end(), sigma.begin());
+    std::copy(table.decayamp.begin(), table.decayamp.end(), decayamp.begin());
+    std::copy(table.omegaScale.begin(), table.omegaScale.end(), omegaScale.begin());
+    std::copy(table.omegaOffset.begin(), table.omegaOffset.end(), omegaOffset.begin());
+    std::copy(table.modeGain.begin(), table.modeGain.end(), modeGain.begin());
+    fN = table.fN;
+
+    // the axis terms and excitation the stages are computed from are still the old ones
+    validStages = 0;
+}
+
+void SynthVoice::setModeTable(const ModeTable* table)
+{
+    modeTable = table;
+}
+
+void SynthVoice::setNoteTableCache(NoteTableCache* cache)
+{
+    noteTableCache = cache;
+}
+
+void SynthVoice::setVoiceAllocator(VoiceAllocator* allocator, int slot)
+{
+    voiceAllocator = allocator;
+    voiceSlot = slot;
+    if (voiceAllocator != nullptr)
+        voiceAllocator->setEnabled(voiceSlot, enabled);
+}
+
+// the per-note part of the mode tables, from the cache when this key was played with the same patch
+void SynthVoice::computeNoteTables(const ModeTable::Patch& patch)
+{
+    int maxIndex = getNumModes();
+
+    if (noteTableCache != nullptr)
+    {
+        if (const NoteTableCache::Entry* entry = noteTableCache->find(patch, fomega))
+        {
+            std::copy(entry->omega, entry->omega + maxIndex, omega.begin());
+            std::copy(entry->rejected, entry->rejected + maxIndex, mode_rejected.begin());
+            if (currentAlgorithm == Algorithm::rabenstein)
             {
-                for (int i=0; i<m1; i++)
+                // same operations as getK(), so that a hit gives the same gains as a miss
+                for (int i=0; i<maxIndex; i++)
                 {
-                    sigma[i+m1*(j+m2*k)] = fsigma*(1+p*(pow(i+1,2)*fa*fa2 + pow(j+1,2)*fa2/fa + pow(k+1,2)*fa/fa2 - fbeta));
-                    decayamp[i+m1*(j+m2*k)] = exp(sigma[i+m1*(j+m2*k)]/sr);
+                    knd[i] = modeGain[i];
+                    yi[i] = level * knd[i] / omega[i];
                 }
             }
+            else
+            {
+                std::copy(entry->gain, entry->gain + maxIndex, knd.begin());
+            }
+            maxh = entry->maxh;
+            return;
+        }
+    }
+
+    getw();
+    getK();
+    findmax();
+
+    if (noteTableCache != nullptr)
+    {
+        if (NoteTableCache::Entry* entry = noteTableCache->add(patch, fomega, maxIndex))
+        {
+            std::copy(omega.begin(), omega.begin() + maxIndex, entry->omega);
+            std::copy(mode_rejected.begin(), mode_rejected.begin() + maxIndex, entry->rejected);
+            if (currentAlgorithm == Algorithm::selesnick)
+                std::copy(knd.begin(), knd.begin() + maxIndex, entry->gain);
+            entry->maxh = maxh;
         }
     }
 }
 
-// get coefficient omega for the impulse response
-void SynthVoice::selesnick_getw(double p)
+
+// findmax functions find value of first sample and scale everything else based on this value
+void SynthVoice::findmax()
 {
-    // 1D
-    if (dim == 0)
+    if (currentAlgorithm == Algorithm::rabenstein)
+        findmaxFor<Algorithm::rabenstein>();
+    else
+        findmaxFor<Algorithm::selesnick>();
+}
+
+template <Algorithm algorithm>
+void SynthVoice::findmaxFor()
+{
+    double h = 0;
+
+    int maxIndex = getNumModes();
+
+    for (int i=0; i<maxIndex; i++)
     {
-        double fsigma = -1/ftau;
-        for (int i=0; i<m1; i++)
-        {
-            double interm = pow(i+1,2);  // M^2
-            omega[i] = sqrt(pow(fd*fomega*interm, 2) + interm * (pow(fsigma*(1-p), 2) + pow(fomega,2)*(1-pow(fd, 2))) - pow(fsigma*(1-p), 2));
+        if constexpr (algorithm == Algorithm::selesnick)
+            h += knd[i] * exp(sigma[i]*M_PI_2 / omega[i]);
+        else
+            h += yi[i] * knd[i] * exp(-alpha[i]*M_PI_2 / omega[i]);
+    }
+    if constexpr (algorithm == Algorithm::rabenstein) h /= fN*level;
 
-            // remove aliasing by checking whether the mode frequency is above Nyquist
-            mode_rejected[i] = ((omega[i]/(2*M_PI)) >= (sr/2));
-        }
+    if (h == 0) h = 1;
+
+    maxh = h;
+}
+
+void SynthVoice::initDecayampn()
+{
+    int maxIndex = getNumModes();
+
+    for (int i=0; i<maxIndex; i++)
+        decayampn[i] = 1.0;
+}
+
+
+//==================================
+void SynthVoice::prepareActiveModes()
+{
+    if (currentAlgorithm == Algorithm::rabenstein)
+        prepareActiveModesFor<Algorithm::rabenstein>();
+    else
+        prepareActiveModesFor<Algorithm::selesnick>();
+}
+
+template <Algorithm algorithm>
+void SynthVoice::prepareActiveModesFor()
+{
+    activePhases.clear();
+    activeIncrements.clear();
+    activeGains.clear();
+    activeDecays.clear();
+    activeEnvStates.clear();
+    activePeriodCount.clear();
+    activeModeIndex.clear();
+
+    if (!trig) return;
+
+    double lvl = (algorithm == Algorithm::rabenstein ? 1.0 / fN : level);
+    double gainScale = lvl / maxh;
+
+    int maxIndex = getNumModes();
+
+    // gather the modes below Nyquist first, so that the arrays are filled without push_back
+    activeModeIndex.resize(maxIndex);
+    size_t numActive = 0;
+    for (int i = 0; i < maxIndex; i++)
+    {
+        activeModeIndex[numActive] = i;
+        numActive += (mode_rejected[i] ? 0 : 1);
     }
-    // 2D
-    else if (dim == 1)
+    activeModeIndex.resize(numActive);
+
+    activePhases.assign(numActive, 0);       // Initial phase is always 0 for now as we start at t=0
+    activeEnvStates.assign(numActive, 1.0);  // Starts at 1.0
+    activePeriodCount.assign(numActive, 0);  // New note, period 0
+    activeIncrements.resize(numActive);
+    activeGains.resize(numActive);
+    activeDecays.resize(numActive);
+
+    for (size_t n = 0; n < numActive; n++)
     {
-        double fbeta = fa + 1/fa;
-        double fsigma = -1/ftau;
+        int i = activeModeIndex[n];
+
+        // Calculate phase increment per sample
+        // omega is angular frequency (rad/s)
+        // Map 2pi -> 2^32 (4294967296.0)
+        // inc = (omega / (sr * 2.0 * M_PI)) * 4294967296.0
+        double increment = (omega[i] / (sr * 2.0 * M_PI)) * 4294967296.0;
+        activeIncrements[n] = static_cast<uint32_t>(increment);
+
+        // Combined Gain
+        if constexpr (algorithm == Algorithm::rabenstein)
+            activeGains[n] = knd[i] * yi[i] * gainScale;
+        else
+            activeGains[n] = knd[i] * gainScale;
+
+        // Decay
+        activeDecays[n] = decayamp[i];
+    }
 
-        int index = 0;
+    attackDone = (atk <= 0.0);
+    numModesAtNyquist = 0;
+    spectralActive = false;
+    multirateActive = false;
+    renderModesFn = renderFunctions[algorithm][attackDone ? 0 : 1];
+
+    blockIncrements.resize(activePhases.size());
+    blockGains.resize(activePhases.size());
+    blockDecays.resize(activePhases.size());
+    blockIncrementSteps.resize(activePhases.size());
+    blockIncrementStepFractions.resize(activePhases.size());
+
+    floatGains.resize(activePhases.size());
+    floatDecays.resize(activePhases.size());
+    floatEnvStates.resize(activePhases.size());
+
+    activeDecayPowers.resize(activePhases.size() * ModeBank::envelopeChunk);
+    activeChunkDecays.resize(activePhases.size());
+    decayPowersValid = false;
+
+    activeOscRe.resize(activePhases.size());
+    activeOscIm.resize(activePhases.size());
+    activeRotorRe.resize(activePhases.size());
+    activeRotorIm.resize(activePhases.size());
+    phasorsValid = false;
+    rotorsValid = false;
+
+    activeKeep.resize(activePhases.size());
+    activeScores.resize(activePhases.size());
+    rankedScores.reserve(activePhases.size());
+
+    trimToModeBudget();
+}
 
-        for (int j=0; j<m2; j++)
+void SynthVoice::updateActiveDecays()
+{
+    // This is called when decay rates change (e.g. release, sample rate change)
+    // We need to re-match the active modes with their new decay rates.
+    for (size_t i = 0; i < activeDecays.size(); i++)
+    {
+        activeDecays[i] = decayamp[activeModeIndex[i]];
+    }
+
+    rotorsValid = false;
+    decayPowersValid = false;
+    spectralPartitionValid = false;
+}
+
+// Glides the pitch, dispersion, shape and damp of the sounding note towards the knobs, and retunes
+// the active modes when they moved. Called once per control period, returns whether they did.
+bool SynthVoice::updateModulation()
+{
+    bool moved = (modulatedPitch != fpitch || modulatedD != nextd || modulatedP != fp
+                  || (dim >= 1 && modulatedA != nexta) || (dim >= 2 && modulatedA2 != nexta2));
+    if (!moved) return false;
+
+    // one-pole glide, snapped to the knob once close enough
+    double amount = 1 - exp(-MODULATION_INTERVAL / (FTM_MODULATION_SMOOTHING_MS / 1000.0 * sr));
+    auto glide = [amount] (double& value, double target)
+    {
+        value += (target - value) * amount;
+        if (abs(target - value) <= 1e-6 * (1 + abs(target))) value = target;
+    };
+    glide(modulatedPitch, fpitch);
+    glide(modulatedD, nextd);
+    glide(modulatedP, fp);
+    if (dim >= 1) glide(modulatedA, nexta);
+    if (dim >= 2) glide(modulatedA2, nexta2);
+
+    fomega = keyFomega * pow(2.0, modulatedPitch/12.0);
+    fd = modulatedD;
+    fa = modulatedA;
+    fa2 = modulatedA2;
+
+    // the decays follow the release gates like in stopNote()
+    bool released = !isKeyDown();
+    modulateActiveModes((released && bgate) ? frel : noteTau, (released && bpGate) ? fring : modulatedP);
+    return true;
+}
+
+// new increments and decays of the active modes, without rebuilding the list. Only the per-axis
+// tables are recomputed, each mode gathers its own from them (see ModeBank::retune()).
+void SynthVoice::modulateActiveModes(double _tau, double p)
+{
+    // the low bands are ahead with the old increments
+    if (multirateActive) leaveMultirate();
+
+    // omega^2 = A*n^2 + B*n + C for the summed axis terms n, with the held sustain and damp
+    // (see selesnick_getwTerms() and rabenstein_getwTerms())
+    double fomega2 = fomega*fomega;
+    double A, B, C;
+    if (currentAlgorithm == Algorithm::rabenstein)
+    {
+        double d1, d3;
+        rabenstein_getAxisTables(_tau, p, d1, d3);
+
+        double area = 1;
+        double fbeta = 1;
+        if (dim == 1)
         {
-            for (int i=0; i<m1; i++)
-            {
-                index = i+m1*j;
+            area = fa;
+            fbeta = fa + 1/fa;
+        }
+        else if (dim == 2)
+        {
+            area = fa*fa2;
+            fbeta = fa*fa2 + fa/fa2 + fa2/fa;
+        }
+        double q = modulatedP;
+        double EIScale = pow(fd*area, 2);
+        double EIOffset = pow(q*area/noteTau, 2);
+        double TScale = area * (1/fbeta - fd*fd * fbeta);
+        double TOffset = area * (1/fbeta - q*q*fbeta) / noteTau*noteTau;
+        d1 = 2 * (1 - q*fbeta) / noteTau;
+        d3 = -2 * q * area / noteTau;
+
+        // beta - alpha^2
+        A = fomega2*EIScale + EIOffset - d3*d3/4;
+        B = fomega2*TScale + TOffset + d1*d3/2;
+        C = -d1*d1/4;
+    }
+    else
+    {
+        double fbeta = selesnick_getAxisTables(_tau, p);
 
-                double interm = pow(i+1,2)*fa + pow(j+1,2)/fa;
-                omega[index] = sqrt(pow(fd*fomega*interm, 2) + interm * (pow(fsigma*(1-p*fbeta), 2)/fbeta + pow(fomega, 2)*(1-pow(fd*fbeta, 2))/fbeta) - pow(fsigma*(1-p*fbeta), 2));
+        double q = modulatedP;
+        double fsigma = -1/noteTau;
+        double b = pow(fsigma*(1-q*fbeta), 2)/fbeta;
+        double bScale = (1-pow(fd*fbeta, 2))/fbeta;
+        double c = pow(fsigma*(1-q*fbeta), 2);
 
-                // aliasing removal
-                mode_rejected[index] = ((omega[index]/(2*M_PI)) >= (sr/2));
-            }
+        A = fomega2*fd*fd;
+        B = fomega2*bScale + b;
+        C = -c;
+    }
+
+    // the second and third axes folded into one table, indexed like the modes of one row
+    int size2 = getAxisSize(2);
+    int size3 = getAxisSize(3);
+    for (int k = 0; k < size3; k++)
+    {
+        for (int j = 0; j < size2; j++)
+        {
+            axisTerm23[j + size2*k] = axisTerm2[j] + axisTerm3[k];
+            axisDecay23[j + size2*k] = axisDecay2[j] * axisDecay3[k];
         }
     }
-    // 3D
-    else if (dim == 2)
+    ModeBank::AxisTables tables = { axisTerm1, axisDecay1, axisTerm23.data(), axisDecay23.data(), m1 };
+
+    // 2pi -> 2^32, the Rabenstein gains include 1/omega like for the pitch bend
+    ModeBank::retune(tables, activeModeIndex.data(), A, B, C, 4294967296.0 / (sr * 2.0 * M_PI),
+                     currentAlgorithm == Algorithm::rabenstein,
+                     activeIncrements.data(), activeGains.data(), activeDecays.data(), activePhases.size());
+
+    // they are skipped like the modes bent above Nyquist, and come back with their gains
+    numModesAtNyquist = size_t(std::count(activeIncrements.begin(), activeIncrements.end(), 0x80000000u));
+
+    rotorsValid = false;
+    decayPowersValid = false;
+    spectralPartitionValid = false;
+
+    // the axis tables no longer match the patch
+    validStages &= ~(dampingStage | frequencyStage);
+}
+
+// drops the modes that have decayed below the threshold
+// (called at block boundaries, the order of the remaining modes is kept)
+void SynthVoice::cullInaudibleModes()
+{
+    if (modeCullThreshold <= 0.0) return;
+
+    size_t numActive = activePhases.size();
+    bool anyCulled = false;
+
+    for (size_t i = 0; i < numActive; i++)
     {
-        double fbeta = fa*fa2 + fa/fa2 + fa2/fa;
-        double fsigma = -1/ftau;
+        // growing modes (decay > 1) are never culled
+        bool audible = (abs(activeGains[i] * activeEnvStates[i]) >= modeCullThreshold
+                        || activeDecays[i] > 1.0);
+        activeKeep[i] = audible;
+        anyCulled |= !audible;
+    }
+
+    if (anyCulled) compactActiveModes();
+}
 
-        int index = 0;
+// keeps only the highest-energy modes when there are more than this voice's share of the budget
+void SynthVoice::trimToModeBudget()
+{
+    if (modeBudget == nullptr) return;
+
+    size_t share = modeBudget->getShare();
+    size_t numActive = activePhases.size();
+    if (numActive <= share) return;
+
+    // remaining energy of a decaying sine: (gain*env)^2 / (1 - decay^2)
+    for (size_t i = 0; i < numActive; i++)
+    {
+        double amp = activeGains[i] * activeEnvStates[i];
+        double d2 = activeDecays[i] * activeDecays[i];
+        activeScores[i] = (d2 < 1.0 ? amp*amp / (1.0 - d2) : HUGE_VAL);
+        activeKeep[i] = false;
+    }
 
-        for (int k=0; k<m3; k++)
+    // find the share-th largest score (rankedScores has enough capacity, no allocation here)
+    rankedScores.assign(activeScores.begin(), activeScores.begin() + numActive);
+    std::nth_element(rankedScores.begin(), rankedScores.begin() + (share - 1), rankedScores.end(),
+                     std::greater<double>());
+    double minScore = rankedScores[share - 1];
+
+    // keep everything strictly above the cut, then fill the remaining slots with ties
+    size_t kept = 0;
+    for (size_t i = 0; i < numActive; i++)
+    {
+        if (activeScores[i] > minScore)
         {
-            for (int j=0; j<m2; j++)
-            {
-                for (int i=0; i<m1; i++)
-                {
-                    index = i+m1*(j+m2*k);
+            activeKeep[i] = true;
+            kept++;
+        }
+    }
+    for (size_t i = 0; i < numActive && kept < share; i++)
+    {
+        if (!activeKeep[i] && activeScores[i] == minScore)
+        {
+            activeKeep[i] = true;
+            kept++;
+        }
+    }
 
-                    double interm = pow(i+1,2)*fa*fa2 + pow(j+1,2)*fa2/fa + pow(k+1,2)*fa/fa2;
-                    omega[index] = sqrt(pow(fd*fomega*interm, 2) + interm * (pow(fsigma*(1-p*fbeta), 2)/fbeta + pow(fomega, 2)*(1-pow(fd*fbeta, 2))/fbeta) - pow(fsigma*(1-p*fbeta), 2));
+    compactActiveModes();
+}
 
-                    // aliasing removal
-                    mode_rejected[index] = ((omega[index]/(2*M_PI)) >= (sr/2));
-                }
-            }
+// removes the modes not flagged in activeKeep from all the active* arrays
+void SynthVoice::compactActiveModes()
+{
+    size_t numActive = activePhases.size();
+    size_t kept = 0;
+    size_t keptOscillatorModes = 0;
+    size_t keptAtNyquist = 0;
+    int keptBand = 0;
+    size_t keptBandSizes[BandUpsampler::maxBands] = {};
+
+    for (size_t i = 0; i < numActive; i++)
+    {
+        if (!activeKeep[i]) continue;
+
+        // the order is kept, so the oscillator modes stay in front of the spectral ones
+        // and the octave bands stay sorted
+        if (i < numOscillatorModes) keptOscillatorModes++;
+        if (activeIncrements[i] == 0x80000000u) keptAtNyquist++;
+        if (multirateActive)
+        {
+            while (i >= bandStart[keptBand + 1]) keptBand++;
+            keptBandSizes[keptBand]++;
+        }
+
+        if (kept != i)
+        {
+            activePhases[kept] = activePhases[i];
+            activeIncrements[kept] = activeIncrements[i];
+            activeGains[kept] = activeGains[i];
+            activeDecays[kept] = activeDecays[i];
+            activeEnvStates[kept] = activeEnvStates[i];
+            activePeriodCount[kept] = activePeriodCount[i];
+            activeModeIndex[kept] = activeModeIndex[i];
+
+            activeOscRe[kept] = activeOscRe[i];
+            activeOscIm[kept] = activeOscIm[i];
+            activeRotorRe[kept] = activeRotorRe[i];
+            activeRotorIm[kept] = activeRotorIm[i];
         }
+        kept++;
     }
+
+    if (kept == numActive) return;
+
+    numOscillatorModes = keptOscillatorModes;
+    numModesAtNyquist = keptAtNyquist;
+    if (multirateActive)
+        for (int b = 0; b < BandUpsampler::maxBands; b++)
+            bandStart[b + 1] = bandStart[b] + keptBandSizes[b];
+
+    // shrinking never reallocates
+    activePhases.resize(kept);
+    activeIncrements.resize(kept);
+    activeGains.resize(kept);
+    activeDecays.resize(kept);
+    activeEnvStates.resize(kept);
+    activePeriodCount.resize(kept);
+    activeModeIndex.resize(kept);
+    activeKeep.resize(kept);
+    activeScores.resize(kept);
+
+    activeOscRe.resize(kept);
+    activeOscIm.resize(kept);
+    activeRotorRe.resize(kept);
+    activeRotorIm.resize(kept);
+
+    blockIncrements.resize(kept);
+    blockGains.resize(kept);
+    blockDecays.resize(kept);
+    blockIncrementSteps.resize(kept);
+    blockIncrementStepFractions.resize(kept);
+
+    floatGains.resize(kept);
+    floatDecays.resize(kept);
+    floatEnvStates.resize(kept);
+
+    activeDecayPowers.resize(kept * ModeBank::envelopeChunk);
+    activeChunkDecays.resize(kept);
+    decayPowersValid = false;
 }
 
-// get coefficient k for the impulse response
-void SynthVoice::selesnick_getK()
+void SynthVoice::updateDecayPowers()
 {
-    double l1 = M_PI;
-    double x1 = l1*r1;
+    const int chunk = ModeBank::envelopeChunk;
 
-    // 1D
-    if (dim == 0)
+    for (size_t i = 0; i < activeDecays.size(); i++)
     {
-        for (int i=0; i<m1; i++)
+        double power = 1.0;
+        for (int k = 0; k < chunk; k++)
         {
-            knd[i] = f1[i] * sin((i+1)*x1*M_PI/l1) / omega[i];
+            activeDecayPowers[i*chunk + k] = power;
+            power *= activeDecays[i];
         }
+        activeChunkDecays[i] = power;
     }
-    // 2D
-    else if (dim == 1)
+
+    decayPowersValid = true;
+}
+
+// switches the inverse-FFT rendering on above spectralModeThreshold active modes (and off again
+// below half of it), and keeps the modes sorted between the oscillators and the spectral bank
+void SynthVoice::updateSpectralModes()
+{
+    size_t numActive = activePhases.size();
+
+    // only replaces the default lookup-table kernel, and not during the attack window
+    bool eligible = (spectralModeThreshold > 0 && attackDone && !modulating
+                     && oscillatorEngine == OscillatorEngine::lookupTable && !singlePrecision
+                     && envelopeEvaluation == EnvelopeEvaluation::recursive);
+
+    if (!eligible || numActive < size_t(spectralModeThreshold) / 2)
     {
-        double l2 = fa*M_PI;
-        double x2 = l2*r2;
+        spectralActive = false;
+        return;
+    }
+    if (!spectralActive && numActive < size_t(spectralModeThreshold))
+        return;
+
+    if (!spectralActive)
+    {
+        if (multirateActive) leaveMultirate();
+        spectralActive = true;
+        spectralPartitionValid = false;
+    }
+    if (spectralPartitionValid) return;
 
-        for (int j=0; j<m2; j++)
+    // modes decaying too fast for the frame interpolation stay on the oscillators, in front
+    size_t front = 0, back = numActive;
+    while (front < back)
+    {
+        if (!SpectralModeBank::isSlowEnough(activeDecays[front]))
+            front++;
+        else if (SpectralModeBank::isSlowEnough(activeDecays[back - 1]))
+            back--;
+        else
+            swapActiveModes(front++, --back);
+    }
+    numOscillatorModes = front;
+
+    // the modes of the pending frames may have changed, start over
+    spectralModes.reset();
+    spectralPartitionValid = true;
+}
+
+// sorts the modes by octave band when the multirate path can take over some of them
+// (only with the default kernel, and never together with the spectral bank)
+void SynthVoice::updateMultirateBands()
+{
+    // also steps aside while the pitch wheel or a modulated knob moves
+    bool eligible = (multirate && attackDone && !spectralActive && !modulating && numModesAtNyquist == 0
+                     && oscillatorEngine == OscillatorEngine::lookupTable && !singlePrecision
+                     && envelopeEvaluation == EnvelopeEvaluation::recursive
+                     && pow(2.0, pitchBend) == renderedPitchMultiplier);
+    size_t numActive = activePhases.size();
+
+    if (multirateActive)
+    {
+        // stays on until the low bands have been culled
+        if (!eligible || bandStart[1] == numActive)
+            leaveMultirate();
+        return;
+    }
+    if (!eligible) return;
+
+    // full-rate oscillators saved by the low bands, against the cost of the interpolators
+    double savedModes = 0.0;
+    for (size_t i = 0; i < numActive; i++)
+        savedModes += 1.0 - 1.0 / (1 << getOctaveBand(activeIncrements[i]));
+    if (savedModes < MULTIRATE_MIN_SAVED_MODES) return;
+
+    // one partition pass per band, lowest band index first
+    size_t front = 0;
+    numBands = 1;
+    for (int band = 0; band < BandUpsampler::maxBands; band++)
+    {
+        bandStart[band] = front;
+        size_t back = numActive;
+        while (front < back)
         {
-            for (int i=0; i<m1; i++)
-            {
-                knd[i+m1*j] = f1[i]*f2[j] * sin((i+1)*x1*M_PI/l1) * sin((j+1)*x2*M_PI/l2) / omega[i+m1*j];
-            }
+            if (getOctaveBand(activeIncrements[front]) == band)
+                front++;
+            else if (getOctaveBand(activeIncrements[back - 1]) != band)
+                back--;
+            else
+                swapActiveModes(front++, --back);
         }
+        if (front > bandStart[band]) numBands = band + 1;
     }
-    // 3D
-    else if (dim == 2)
-    {
-        double l2 = fa*M_PI;
-        double l3 = fa2*M_PI;
-        double x2 = l2*r2;
-        double x3 = l3*r3;
+    bandStart[BandUpsampler::maxBands] = numActive;
 
-        for (int k=0; k<m3; k++)
+    bandIncrements.resize(numActive);
+    bandDecays.resize(numActive);
+
+    multirateActive = true;
+    multiratePrimed = false;
+}
+
+// brings the low bands, which are rendered ahead of the output, back to the current sample
+void SynthVoice::leaveMultirate()
+{
+    if (multiratePrimed)
+    {
+        for (int band = 1; band < numBands; band++)
         {
-            for (int j=0; j<m2; j++)
+            int lead = int(bandUpsampler.getLead(band));
+
+            for (size_t i = bandStart[band]; i < bandStart[band + 1]; i++)
             {
-                for (int i=0; i<m1; i++)
-                {
-                    knd[i+m1*(j+m2*k)] = f1[i]*f2[j]*f3[k] * sin((i+1)*x1*M_PI/l1) * sin((j+1)*x2*M_PI/l2) * sin((k+1)*x3*M_PI/l3) / omega[i+m1*(j+m2*k)];
-                }
+                // same increments as the last block
+                uint32_t increment = static_cast<uint32_t>(static_cast<uint64_t>(
+                    static_cast<double>(activeIncrements[i]) * renderedPitchMultiplier));
+                activePhases[i] -= increment * static_cast<uint32_t>(lead);
+                activeEnvStates[i] *= ModeBank::integerPower(1.0 / activeDecays[i], lead);
             }
         }
     }
+
+    multirateActive = false;
+    multiratePrimed = false;
 }
 
+void SynthVoice::swapActiveModes(size_t a, size_t b)
+{
+    std::swap(activePhases[a], activePhases[b]);
+    std::swap(activeIncrements[a], activeIncrements[b]);
+    std::swap(activeGains[a], activeGains[b]);
+    std::swap(activeDecays[a], activeDecays[b]);
+    std::swap(activeEnvStates[a], activeEnvStates[b]);
+    std::swap(activePeriodCount[a], activePeriodCount[b]);
+    std::swap(activeModeIndex[a], activeModeIndex[b]);
+
+    std::swap(activeOscRe[a], activeOscRe[b]);
+    std::swap(activeOscIm[a], activeOscIm[b]);
+    std::swap(activeRotorRe[a], activeRotorRe[b]);
+    std::swap(activeRotorIm[a], activeRotorIm[b]);
+
+    decayPowersValid = false;
+}
 
-void SynthVoice::rabenstein_getCoefficients(double _tau, double p)
+void SynthVoice::leaveModeBudget()
 {
-    double l0 = M_PI;  // constant
+    if (countedInBudget && modeBudget != nullptr)
+    {
+        int count = modeBudget->numSoundingVoices.load();
+        while (count > 0 && !modeBudget->numSoundingVoices.compare_exchange_weak(count, count - 1)) {}
+    }
+    countedInBudget = false;
+}
 
-    // 1D
-    if (dim == 0)
+// what the active modes have left to play, the sum of their trimToModeBudget() scores
+double SynthVoice::getRemainingEnergy() const
+{
+    double energy = 0;
+    for (size_t i = 0; i < activePhases.size(); i++)
     {
-        double EI = pow(fd*fomega, 2) + pow(p/_tau, 2);
-        double T = ((1 - p*p) / _tau*_tau + fomega*fomega * (1 - fd*fd));
+        double amp = activeGains[i] * activeEnvStates[i];
+        double d2 = activeDecays[i] * activeDecays[i];
+        energy += (d2 < 1.0 ? amp*amp / (1.0 - d2) : HUGE_VAL);
+    }
+    return energy * mainVolume * mainVolume;
+}
 
-        double d1 = 2 * (1 - p) / _tau;
-        double d3 = -2 * p / _tau;
+//==================================
+// this function synthesizes the signal value at each sample
+void SynthVoice::synthesizeBlock(int numSamples)
+{
+    // ensure scratch buffer is large enough
+    if (buffer.size() < (size_t)numSamples)
+        buffer.resize(numSamples);
 
-        double n, n2;
+    // clear scratch buffer
+    std::fill(buffer.begin(), buffer.begin() + numSamples, 0.0);
 
-        for (int i=0; i<m1; i++)
-        {
-            n = pow(i+1, 2);
-            n2 = n*n;
+    cullInaudibleModes();
+    trimToModeBudget();
+    updateSpectralModes();
+    updateMultirateBands();
 
-            beta[i] = EI * n2 + T * n;
-            alpha[i] = (d1 - d3 * n) / 2;
+    (this->*renderModesFn)(numSamples);
+}
 
-            decayamp[i] = exp(-alpha[i]/sr);
-        }
+// render kernels, picked once per note: [algorithm][attack window still running]
+const SynthVoice::RenderFunction SynthVoice::renderFunctions[2][2] = {
+    { &SynthVoice::renderModes<Algorithm::selesnick, false>,  &SynthVoice::renderModes<Algorithm::selesnick, true> },
+    { &SynthVoice::renderModes<Algorithm::rabenstein, false>, &SynthVoice::renderModes<Algorithm::rabenstein, true> },
+};
 
-        fN = M_PI / 4;
-    }
-    // 2D
-    else if (dim == 1)
+template <Algorithm algorithm, bool hasAttack>
+void SynthVoice::renderModes(int numSamples)
+{
+    // block processing: iterate active modes
+    size_t numActive = activePhases.size();
+
+    // pitch bend, reached at the end of this block
+    double currentPitchMultiplier = pow(2.0, pitchBend);
+    double previousPitchMultiplier = renderedPitchMultiplier;
+    renderedPitchMultiplier = currentPitchMultiplier;
+    uint32_t nyquistInc = 0x80000000;  // corresponding to SR/2
+
+    if constexpr (hasAttack)
     {
-        double l2 = M_PI*fa;
-        double fbeta = fa + 1/fa;
+        synthesizeAttackBlock<algorithm>(numSamples, currentPitchMultiplier);
 
-        double EI = pow(fd*fomega*fa, 2) + pow(p*fa/_tau, 2);
-        double T = (fa * (1/fbeta - p*p*fbeta) / _tau*_tau
-                + fa * fomega*fomega * (1/fbeta - fd*fd * fbeta));
+        // the following blocks go straight to the attack-free kernel
+        if (attackDone) renderModesFn = &SynthVoice::renderModes<algorithm, false>;
+        return;
+    }
 
-        double d1 = 2 * (1 - p*fbeta) / _tau;
-        double d3 = -2 * p * fa / _tau;
+    if (modeBankScratch.size() < ModeBank::getScratchSize(numSamples))
+        modeBankScratch.resize(ModeBank::getScratchSize(numSamples));
 
-        int index = 0;
-        double n, n2;
+    // the default kernel glides from the previous bend instead of jumping to the new one
+    // (the other engines still use a constant bend per block)
+    if (currentPitchMultiplier != previousPitchMultiplier
+        && oscillatorEngine == OscillatorEngine::lookupTable && !singlePrecision
+        && envelopeEvaluation == EnvelopeEvaluation::recursive && !spectralActive)
+    {
+        synthesizePitchRampBlock<algorithm>(numSamples, previousPitchMultiplier, currentPitchMultiplier);
+        return;
+    }
+
+    const uint32_t* increments = activeIncrements.data();
+    const double* gains = activeGains.data();
+    const double* decays = activeDecays.data();
 
-        for (int j=0; j<m2; j++)
+    if (currentPitchMultiplier != 1.0 || numModesAtNyquist > 0)
+    {
+        // modes bent above Nyquist are frozen (no phase/envelope advance) and muted
+        for (size_t i = 0; i < numActive; i++)
         {
-            for (int i=0; i<m1; i++)
+            uint64_t largeInc = static_cast<uint64_t>(static_cast<double>(activeIncrements[i]) * currentPitchMultiplier);
+
+            if (largeInc >= nyquistInc)
             {
-                index = i+m1*j;
+                blockIncrements[i] = 0;
+                blockGains[i] = 0.0;
+                blockDecays[i] = 1.0;
+                continue;
+            }
 
-                n = pow((i+1)*M_PI/l0, 2) + pow((j+1)*M_PI/l2, 2);
-                n2 = n*n;
+            blockIncrements[i] = static_cast<uint32_t>(largeInc);
+            if constexpr (algorithm == Algorithm::rabenstein)
+                blockGains[i] = activeGains[i] / currentPitchMultiplier;
+            else
+                blockGains[i] = activeGains[i];
+            blockDecays[i] = activeDecays[i];
+        }
 
-                beta[index] = EI * n2 + T * n;
-                alpha[index] = (d1 - d3 * n) / 2;
+        increments = blockIncrements.data();
+        gains = blockGains.data();
+        decays = blockDecays.data();
+    }
 
-                decayamp[index] = exp(-alpha[index]/sr);
-            }
-        }
+    if (spectralActive)
+    {
+        synthesizeSpectralBlock(numSamples, increments, gains, decays);
+        return;
+    }
 
-        fN = M_PI * l2 / 4;
+    if (multirateActive)
+    {
+        synthesizeMultirateBlock(numSamples, increments, gains, decays);
+        return;
     }
-    // 3D
-    else if (dim == 2)
+
+    if (oscillatorEngine == OscillatorEngine::phasor)
     {
-        double l2 = M_PI*fa;
-        double l3 = M_PI*fa2;
-        double fbeta = fa*fa2 + fa/fa2 + fa2/fa;
+        synthesizePhasorBlock(numSamples, currentPitchMultiplier, increments, gains, decays);
+        return;
+    }
 
-        double EI = pow(fd*fomega*fa*fa2, 2) + pow(p*fa*fa2/_tau, 2);
-        double T = (fa*fa2 * (1/fbeta - p*p*fbeta) / _tau*_tau
-                + fa*fa2 * fomega*fomega * (1/fbeta - fd*fd * fbeta));
+    if (oscillatorEngine == OscillatorEngine::interpolatedTable)
+    {
+        ModeBank::renderInterpolated(compactSinLUT, COMPACT_SIN_LUT_BITS, activePhases.data(),
+                                     increments, gains, decays, activeEnvStates.data(), numActive,
+                                     buffer.data(), numSamples, modeBankScratch.data());
+        phasorsValid = false;
+        return;
+    }
 
-        double d1 = 2 * (1 - p*fbeta) / _tau;
-        double d3 = -2 * p * fa*fa2 / _tau;
+    if (singlePrecision)
+    {
+        synthesizeFloatBlock(numSamples, increments, gains, decays);
+        return;
+    }
 
-        int index = 0;
-        double n, n2;
+    if (envelopeEvaluation == EnvelopeEvaluation::blockExponential)
+    {
+        if (!decayPowersValid) updateDecayPowers();
 
-        for (int k=0; k<m3; k++)
-        {
-            for (int j=0; j<m2; j++)
-            {
-                for (int i=0; i<m1; i++)
-                {
-                    index = i+m1*(j+m2*k);
+        ModeBank::renderBlockExponential(sinLUT, SIN_LUT_SHIFT, activePhases.data(), increments,
+                                         gains, decays, activeDecayPowers.data(), activeChunkDecays.data(),
+                                         activeEnvStates.data(), numActive, buffer.data(), numSamples);
+        phasorsValid = false;
+        return;
+    }
 
-                    n = pow((i+1)*M_PI/l0, 2) + pow((j+1)*M_PI/l2, 2) + pow((k+1)*M_PI/l3, 2);
-                    n2 = n*n;
+    ModeBank::render(sinLUT, SIN_LUT_SHIFT, activePhases.data(), increments, nullptr, nullptr, gains, decays,
+                     activeEnvStates.data(), numActive, buffer.data(), numSamples,
+                     modeBankScratch.data());
+    phasorsValid = false;
+}
 
-                    beta[index] = EI * n2 + T * n;
-                    alpha[index] = (d1 - d3 * n) / 2;
+// pitch-bend glide: every increment ramps linearly from startMultiplier to endMultiplier,
+// reaching the new value (rounded) exactly on the last sample of the block. As Synthesiser splits the rendering
+// at each pitch-wheel event, the ramps run from one wheel timestamp to the next.
+template <Algorithm algorithm>
+void SynthVoice::synthesizePitchRampBlock(int numSamples, double startMultiplier, double endMultiplier)
+{
+    size_t numActive = activePhases.size();
+    uint32_t nyquistInc = 0x80000000;  // corresponding to SR/2
 
-                    decayamp[index] = exp(-alpha[index]/sr);
-                }
-            }
+    for (size_t i = 0; i < numActive; i++)
+    {
+        double startInc = activeIncrements[i] * startMultiplier;
+        double endInc = activeIncrements[i] * endMultiplier;
+
+        // modes crossing Nyquist during the glide are frozen and muted for the whole block
+        if (jmax(startInc, endInc) >= nyquistInc)
+        {
+            blockIncrements[i] = 0;
+            blockIncrementSteps[i] = 0;
+            blockIncrementStepFractions[i] = 0;
+            blockGains[i] = 0.0;
+            blockDecays[i] = 1.0;
+            continue;
         }
 
-        fN = M_PI * l2 * l3 / 8;
+        // step in 32.32 fixed point, the kernel carries its fractional part from sample to sample.
+        // The first increment is the one from which the carried steps land on endInc.
+        int64_t step = llround((endInc - startInc) / numSamples * 4294967296.0);
+        uint64_t carries = (uint64_t(ModeBank::initialStepFraction)
+                            + uint64_t(numSamples - 1) * uint32_t(step)) >> 32;
+        blockIncrements[i] = static_cast<uint32_t>(llround(endInc) - (step >> 32) * (numSamples - 1)
+                                                   - int64_t(carries));
+        blockIncrementSteps[i] = static_cast<int32_t>(step >> 32);
+        blockIncrementStepFractions[i] = static_cast<uint32_t>(step);
+        blockGains[i] = activeGains[i];
+        blockDecays[i] = activeDecays[i];
     }
-}
 
-// get coefficient omega for the impulse response
-void SynthVoice::rabenstein_getw()
-{
-    int maxIndex = 0;
-    if (dim >= 0) maxIndex = m1;
-    if (dim >= 1) maxIndex *= m2;
-    if (dim >= 2) maxIndex *= m3;
+    ModeBank::render(sinLUT, SIN_LUT_SHIFT, activePhases.data(), blockIncrements.data(),
+                     blockIncrementSteps.data(), blockIncrementStepFractions.data(), blockGains.data(),
+                     blockDecays.data(), activeEnvStates.data(), numActive, buffer.data(), numSamples,
+                     modeBankScratch.data());
+    phasorsValid = false;
 
-    for (int i=0; i<maxIndex; i++)
+    // the Rabenstein gains scale with 1/pitch, which is the same for every mode
+    if constexpr (algorithm == Algorithm::rabenstein)
     {
-        omega[i] = sqrt(abs(beta[i] - alpha[i]*alpha[i]));
-        mode_rejected[i] = ((omega[i]/(2*M_PI)) > (sr/2));
+        double multiplierStep = (endMultiplier - startMultiplier) / numSamples;
+        for (int s = 0; s < numSamples; s++)
+            buffer[s] /= startMultiplier + multiplierStep * (s + 1);
     }
 }
 
-// get coefficients k and y for the impulse response
-void SynthVoice::rabenstein_getK()
+// table-free path: the fixed-point phases and envelopes are only advanced per block,
+// and used to re-seed the phasors every PHASOR_RENORM_INTERVAL samples
+void SynthVoice::synthesizePhasorBlock(int numSamples, double currentPitchMultiplier,
+                                       const uint32_t* increments, const double* gains, const double* decays)
 {
-    // 1D
-    if (dim == 0)
+    size_t numActive = activePhases.size();
+    const double phaseToRadians = 2.0 * M_PI / 4294967296.0;
+
+    if (!rotorsValid || rotorPitchMultiplier != currentPitchMultiplier)
     {
-        for (int i=0; i<m1; i++)
+        for (size_t i = 0; i < numActive; i++)
         {
-            knd[i] = sin((i+1)*M_PI*r1);
-            yi[i] = level * knd[i] / omega[i];
+            double theta = increments[i] * phaseToRadians;
+            activeRotorRe[i] = decays[i] * cos(theta);
+            activeRotorIm[i] = decays[i] * sin(theta);
         }
+        rotorPitchMultiplier = currentPitchMultiplier;
+        rotorsValid = true;
     }
-    // 2D
-    else if (dim == 1)
-    {
-        int index = 0;
 
-        for (int j=0; j<m2; j++)
+    if (!phasorsValid || samplesSinceRenorm >= PHASOR_RENORM_INTERVAL)
+    {
+        for (size_t i = 0; i < numActive; i++)
         {
-            for (int i=0; i<m1; i++)
-            {
-                index = i+m1*j;
-
-                knd[index] = sin((i+1)*M_PI*r1) * sin((j+1)*M_PI*r2);
-                yi[index] = level * knd[index] / omega[index];
-            }
+            double phase = activePhases[i] * phaseToRadians;
+            activeOscRe[i] = activeEnvStates[i] * cos(phase);
+            activeOscIm[i] = activeEnvStates[i] * sin(phase);
         }
+        samplesSinceRenorm = 0;
+        phasorsValid = true;
     }
-    // 3D
-    else if (dim == 2)
-    {
-        int index = 0;
 
-        for (int k=0; k<m3; k++)
-        {
-            for (int j=0; j<m2; j++)
-            {
-                for (int i=0; i<m1; i++)
-                {
-                    index = i+m1*(j+m2*k);
+    ModeBank::renderPhasors(activeOscRe.data(), activeOscIm.data(), activeRotorRe.data(),
+                            activeRotorIm.data(), gains, numActive, buffer.data(), numSamples,
+                            modeBankScratch.data());
 
-                    knd[index] = sin((i+1)*M_PI*r1) * sin((j+1)*M_PI*r2) * sin((k+1)*M_PI*r3);
-                    yi[index] = level * knd[index] / omega[index];
-                }
-            }
-        }
+    // keep the fixed-point state in step, so that it can be used for the next re-seed
+    for (size_t i = 0; i < numActive; i++)
+    {
+        activePhases[i] += increments[i] * static_cast<uint32_t>(numSamples);
+        activeEnvStates[i] = sqrt(activeOscRe[i]*activeOscRe[i] + activeOscIm[i]*activeOscIm[i]);
     }
+    samplesSinceRenorm += numSamples;
 }
 
-
-// findmax functions find value of first sample and scale everything else based on this value
-void SynthVoice::findmax()
+// single-precision path: the phases stay in 32-bit fixed point and the envelopes are kept
+// in double between blocks, so the float recursion can only drift within a single block
+void SynthVoice::synthesizeFloatBlock(int numSamples,
+                                      const uint32_t* increments, const double* gains, const double* decays)
 {
-    double h = 0;
-
-    int maxIndex = 0;
-    if (dim >= 0) maxIndex = m1;
-    if (dim >= 1) maxIndex *= m2;
-    if (dim >= 2) maxIndex *= m3;
+    size_t numActive = activePhases.size();
 
-    double coef, decay;
-    for (int i=0; i<maxIndex; i++)
+    for (size_t i = 0; i < numActive; i++)
     {
-        coef = 1;
-        decay = 0;
-        if (currentAlgorithm == Algorithm::selesnick)
-        {
-            decay = sigma[i];
-        }
-        else if (currentAlgorithm == Algorithm::rabenstein)
-        {
-            coef = yi[i];
-            decay = -alpha[i];
-        }
-        h += coef * knd[i] * exp(decay*M_PI_2 / omega[i]);
+        floatGains[i] = float(gains[i]);
+        floatDecays[i] = float(decays[i]);
+        floatEnvStates[i] = float(activeEnvStates[i]);
     }
-    if (currentAlgorithm == Algorithm::rabenstein) h /= fN*level;
 
-    if (h == 0) h = 1;
+    if (floatBuffer.size() < (size_t)numSamples)
+        floatBuffer.resize(numSamples);
+    if (modeBankScratchFloat.size() < ModeBank::getFloatScratchSize(numSamples))
+        modeBankScratchFloat.resize(ModeBank::getFloatScratchSize(numSamples));
 
-    maxh = h;
-}
+    std::fill(floatBuffer.begin(), floatBuffer.begin() + numSamples, 0.0f);
 
-void SynthVoice::initDecayampn()
-{
-    int maxIndex = 0;
-    if (dim >= 0) maxIndex = m1;
-    if (dim >= 1) maxIndex *= m2;
-    if (dim >= 2) maxIndex *= m3;
+    ModeBank::renderFloat(sinLUTf, SIN_LUT_SHIFT, activePhases.data(), increments,
+                          floatGains.data(), floatDecays.data(), floatEnvStates.data(),
+                          numActive, floatBuffer.data(), numSamples, modeBankScratchFloat.data());
 
-    for (int i=0; i<maxIndex; i++)
-        decayampn[i] = 1.0;
-}
+    for (int s = 0; s < numSamples; s++)
+        buffer[s] += floatBuffer[s];
 
+    // renormalise: advance the double envelopes instead of reading back the float ones
+    for (size_t i = 0; i < numActive; i++)
+        activeEnvStates[i] *= ModeBank::integerPower(decays[i], numSamples);
 
-//==================================
-void SynthVoice::prepareActiveModes()
-{
-    activePhases.clear();
-    activeIncrements.clear();
-    activeGains.clear();
-    activeDecays.clear();
-    activeEnvStates.clear();
-    activePeriodCount.clear();
+    phasorsValid = false;
+}
 
-    if (!trig) return;
+// many-mode path: the fast-decaying modes on the oscillators, the others by inverse FFT.
+// The spectral bank only reads the state, which is advanced here once per block
+void SynthVoice::synthesizeSpectralBlock(int numSamples,
+                                         const uint32_t* increments, const double* gains, const double* decays)
+{
+    size_t numActive = activePhases.size();
+    size_t split = numOscillatorModes;
 
-    double lvl = level;
-    if (currentAlgorithm == Algorithm::rabenstein) lvl = 1.0 / fN;
-    double gainScale = lvl / maxh;
+    ModeBank::render(sinLUT, SIN_LUT_SHIFT, activePhases.data(), increments, nullptr, nullptr, gains, decays,
+                     activeEnvStates.data(), split, buffer.data(), numSamples,
+                     modeBankScratch.data());
 
-    int maxIndex = 0;
-    if (dim >= 0) maxIndex = m1;
-    if (dim >= 1) maxIndex *= m2;
-    if (dim >= 2) maxIndex *= m3;
+    spectralModes.render(sinLUT, SIN_LUT_SHIFT, activePhases.data() + split, increments + split,
+                         gains + split, decays + split, activeEnvStates.data() + split,
+                         numActive - split, buffer.data(), numSamples);
 
-    for (int i = 0; i < maxIndex; i++)
+    for (size_t i = split; i < numActive; i++)
     {
-        if (!mode_rejected[i])
-        {
-            // Initial phase is always 0 for now as we start at t=0
-            activePhases.push_back(0);
+        activePhases[i] += increments[i] * static_cast<uint32_t>(numSamples);
+        activeEnvStates[i] *= ModeBank::integerPower(decays[i], numSamples);
+    }
 
-            // Calculate phase increment per sample
-            // omega is angular frequency (rad/s)
-            // Map 2pi -> 2^32 (4294967296.0)
-            // inc = (omega / (sr * 2.0 * M_PI)) * 4294967296.0
-            double increment = (omega[i] / (sr * 2.0 * M_PI)) * 4294967296.0;
-            activeIncrements.push_back(static_cast<uint32_t>(increment));
+    phasorsValid = false;
+}
 
-            // Combined Gain
-            double y = 1.0;
-            if (currentAlgorithm == Algorithm::rabenstein) y = yi[i];
-            activeGains.push_back(knd[i] * y * gainScale);
+// multirate path: band b is rendered at sr / 2^b and interpolated back to sr
+void SynthVoice::synthesizeMultirateBlock(int numSamples,
+                                          const uint32_t* increments, const double* gains, const double* decays)
+{
+    size_t lowStart = bandStart[1];
 
-            // Decay
-            activeDecays.push_back(decayamp[i]);
-            activeEnvStates.push_back(1.0);  // Starts at 1.0
-            activePeriodCount.push_back(0);  // New note, period 0
+    // per-band-sample increments and decays
+    for (int band = 1; band < numBands; band++)
+    {
+        for (size_t i = bandStart[band]; i < bandStart[band + 1]; i++)
+        {
+            double decay = decays[i];
+            for (int k = 0; k < band; k++) decay *= decay;
+            bandIncrements[i] = increments[i] << band;
+            bandDecays[i] = decay;
         }
     }
-}
 
-void SynthVoice::updateActiveDecays()
-{
-    // This is called when decay rates change (e.g. release, sample rate change)
-    // We need to re-match the active modes with their new decay rates.
-    // Since activeModes list order corresponds to the linear iteration of valid modes,
-    // we can re-iterate to find them.
+    size_t scratchSize = ModeBank::getScratchSize(jmax(numSamples, BandUpsampler::prerollSamples)
+                                                  + 2*BandUpsampler::halfLength);
+    if (modeBankScratch.size() < scratchSize)
+        modeBankScratch.resize(scratchSize);
 
-    int activeIdx = 0;
-    int maxIndex = 0;
-    if (dim >= 0) maxIndex = m1;
-    if (dim >= 1) maxIndex *= m2;
-    if (dim >= 2) maxIndex *= m3;
+    auto renderBand = [&](int band, double* output, int count)
+    {
+        size_t begin = bandStart[band], end = bandStart[band + 1];
+        if (begin == end) return;
 
-    for (int i = 0; i < maxIndex; i++)
+        ModeBank::render(sinLUT, SIN_LUT_SHIFT, activePhases.data() + begin, bandIncrements.data() + begin,
+                         nullptr, nullptr, gains + begin, bandDecays.data() + begin, activeEnvStates.data() + begin,
+                         end - begin, output, count, modeBankScratch.data());
+    };
+
+    if (!multiratePrimed)
     {
-        if (!mode_rejected[i])
+        // start the low bands a little in the past, so that the interpolators are filled
+        // with the modes' history instead of silence by the time they reach this sample
+        bandUpsampler.reset(numBands);
+        for (int band = 1; band < numBands; band++)
         {
-            if (activeIdx < activeDecays.size())
+            int steps = BandUpsampler::prerollSamples >> band;
+            for (size_t i = bandStart[band]; i < bandStart[band + 1]; i++)
             {
-                activeDecays[activeIdx] = decayamp[i];
-                activeIdx++;
+                activePhases[i] -= bandIncrements[i] * static_cast<uint32_t>(steps);
+                activeEnvStates[i] *= ModeBank::integerPower(1.0 / bandDecays[i], steps);
             }
         }
+
+        multiratePreroll.resize(BandUpsampler::prerollSamples);
+        std::fill(multiratePreroll.begin(), multiratePreroll.end(), 0.0);
+        bandUpsampler.process(multiratePreroll.data(), BandUpsampler::prerollSamples, renderBand);
+        multiratePrimed = true;
     }
-}
 
-//==================================
-// this function synthesizes the signal value at each sample
-void SynthVoice::synthesizeBlock(int numSamples)
-{
-    // ensure scratch buffer is large enough
-    if (buffer.size() < (size_t)numSamples)
-        buffer.resize(numSamples);
+    if (lowStart > 0)
+        ModeBank::render(sinLUT, SIN_LUT_SHIFT, activePhases.data(), increments, nullptr, nullptr, gains, decays,
+                         activeEnvStates.data(), lowStart, buffer.data(), numSamples,
+                         modeBankScratch.data());
 
-    // clear scratch buffer
-    std::fill(buffer.begin(), buffer.begin() + numSamples, 0.0);
+    bandUpsampler.process(buffer.data(), numSamples, renderBand);
+    phasorsValid = false;
+}
 
-    // block processing: iterate active modes
+// scalar path used while some modes are still inside the attack window:
+// each mode renders its windowed prefix and its plain remainder as two separate loops
+template <Algorithm algorithm>
+void SynthVoice::synthesizeAttackBlock(int numSamples, double currentPitchMultiplier)
+{
     size_t numActive = activePhases.size();
-
-    // update pitch bend if needed (assuming constant per block for now)
-    double currentPitchMultiplier = pow(2.0, pitchBend);
-    bool applyGainScaling = (currentAlgorithm == Algorithm::rabenstein);
     uint32_t nyquistInc = 0x80000000;  // corresponding to SR/2
 
+    // end of the attack window, in 32-bit fixed-point periods
+    double attackEnd = atk * 4294967296.0;
+
+    attackDone = true;
+
     for (size_t i = 0; i < numActive; i++)
     {
         // apply pitch bend to increment
         uint64_t largeInc = static_cast<uint64_t>(static_cast<double>(activeIncrements[i]) * currentPitchMultiplier);
 
         // anti-aliasing check: if frequency exceeds Nyquist, skip this mode
-        if (largeInc >= nyquistInc) continue;
+        // (and count it as past its window, so that it does not hold the voice in this path)
+        if (largeInc >= nyquistInc)
+            continue;
 
         uint32_t inc = static_cast<uint32_t>(largeInc);
-        uint32_t phase = activePhases[i];
 
         double gain = activeGains[i];
-        if (applyGainScaling) gain /= currentPitchMultiplier;
+        if constexpr (algorithm == Algorithm::rabenstein) gain /= currentPitchMultiplier;
 
         double decay = activeDecays[i];
         double amp = activeEnvStates[i];
 
-        for (int s = 0; s < numSamples; s++)
-        {
-            // direct lookup (truncation) for 256k LUT
-            // top 18 bits = integer index
-            // bottom 14 bits = fractional part (discarded)
-            uint32_t index = phase >> 14;
-
-            double value = sinLUT[index];
+        // position in periods (integer part) and fraction of period (low 32 bits)
+        uint64_t position = (uint64_t(activePeriodCount[i]) << 32) | activePhases[i];
 
-            // Apply Duration-Based Attack Windowing
-            if (atk > 0.0)
-            {
-               // Check if we are still within the attack duration
-               // Use precise floating point position: periods + fractional_phase
-               double currentPos = activePeriodCount[i] + (phase / 4294967296.0);
+        // number of samples of this block that still fall inside the attack window
+        int windowed = 0;
+        if (position < attackEnd && inc > 0)
+        {
+            windowed = int(jmin(ceil((attackEnd - double(position)) / inc), double(numSamples)));
 
-               if (currentPos < atk)
-               {
-                   // Window function: sin^2( pi * t / (2 * dur) )
-                   // Maps t=0 -> 0, t=dur -> 1
-                   // Argument for sin is (pi/2) * (t/dur)
-                   // Map to LUT index [0 .. LUT_SIZE/4]
+            // make the boundary agree with the exact "position < attackEnd" test
+            while (windowed > 0 && double(position + uint64_t(windowed-1)*inc) >= attackEnd)
+                windowed--;
+            while (windowed < numSamples && double(position + uint64_t(windowed)*inc) < attackEnd)
+                windowed++;
+        }
+        else if (position < attackEnd)
+        {
+            windowed = numSamples;
+        }
 
-                   double ratio = currentPos / atk;
+        // windowed prefix
+        for (int s = 0; s < windowed; s++)
+        {
+            // Window function: sin^2( pi * t / (2 * dur) )
+            // Maps t=0 -> 0, t=dur -> 1
+            // Argument for sin is (pi/2) * (t/dur)
+            // Map to LUT index [0 .. LUT_SIZE/4]
+            double ratio = (position / 4294967296.0) / atk;
 
-                   // LUT Size is 0x40000. Quarter is 0x10000.
-                   uint32_t attackIndex = static_cast<uint32_t>(ratio * 0x10000);
+            // LUT Size is 0x40000. Quarter is 0x10000.
+            uint32_t attackIndex = jmin(static_cast<uint32_t>(ratio * 0x10000), uint32_t(0x10000));
 
-                   // Clamp index just in case floating point errors push it slightly over
-                   if (attackIndex > 0x10000) attackIndex = 0x10000;
+            double w = sinLUT[attackIndex];
+            double value = sinLUT[uint32_t(position) >> SIN_LUT_SHIFT];
 
-                   double w = sinLUT[attackIndex];
-                   value *= (w * w);
-               }
-            }
+            buffer[s] += gain * amp * (value * (w * w));
 
-            buffer[s] += gain * amp * value;
+            position += inc;
+            amp *= decay;
+        }
 
-            uint32_t nextPhase = phase + inc;
-            if (nextPhase < phase)
-            {
-               if (activePeriodCount[i] < 255) // prevent overflow wrap-around
-                   activePeriodCount[i]++;
-            }
-            phase = nextPhase;
+        // plain decaying sine for the rest of the block
+        uint32_t phase = uint32_t(position);
+        for (int s = windowed; s < numSamples; s++)
+        {
+            buffer[s] += gain * amp * sinLUT[phase >> SIN_LUT_SHIFT];
+            phase += inc;
             amp *= decay;
         }
+        position += uint64_t(numSamples - windowed) * inc;
 
         // write back state
         activePhases[i] = phase;
+        activePeriodCount[i] = uint8_t(jmin(position >> 32, uint64_t(255)));  // prevent overflow wrap-around
         activeEnvStates[i] = amp;
+
+        if (windowed == numSamples && double(position) < attackEnd) attackDone = false;
     }
+
+    // once every mode is past its window, the voice switches to the plain kernels
+    phasorsValid = false;
 }
 
 void SynthVoice::advanceTime(int numSamples)
@@ -736,9 +1784,12 @@ void SynthVoice::advanceTime(int numSamples)
     nsamp += numSamples;
     t = nsamp / sr;
 
-    if (t >= dur)
+    // also stop once every mode has been culled
+    if (t >= dur || activePhases.empty())
     {
         trig = false;
+        leaveModeBudget();
+        if (voiceAllocator != nullptr) voiceAllocator->noteStopped(voiceSlot);
         clearCurrentNote();
     }
 }
@@ -749,8 +1800,11 @@ void SynthVoice::advanceTime(int numSamples)
 void SynthVoice::startNote(int midiNoteNumber, float velocity, SynthesiserSound */*sound*/,
                            int currentPitchWheelPosition)
 {
-    currentAlgorithm = nextAlgorithm;
-    dim = nextDim;
+    ModeTable::Patch patch = getNextPatch(sr);
+
+    // the tables only grow on the message thread, shrink the largest axis until the body fits
+    shrinkToFit(patch, modeCapacity);
+    applyPatch(patch);
 
     level = velocity;
     if (bkbTrack)
@@ -764,36 +1818,30 @@ void SynthVoice::startNote(int midiNoteNumber, float velocity, SynthesiserSound
         fomega = 440 * 2 * M_PI * pow(2.0, (fpitch - 9.0)/12.0);
     }
     pitchBend = (currentPitchWheelPosition - 8192) / 8192.0;
+    renderedPitchMultiplier = pow(2.0, pitchBend);
+
+    // where the modulated knobs start from
+    keyFomega = fomega / pow(2.0, fpitch/12.0);
+    modulatedPitch = fpitch;
+    modulatedD = fd;
+    modulatedA = fa;
+    modulatedA2 = fa2;
+    modulatedP = fp;
+    noteTau = ftau;
+    modulating = false;
 
     atk = nextAtk;
 
     // sound duration depending on sustain, tau = 0.075 means a 1-second output
     dur = log(1-ftau) / log(1-0.075);
 
-    fd = nextd;
-    fa = nexta;
-    fa2 = nexta2;
-
-    m1 = nextm1;
-    m2 = nextm2;
-    m3 = nextm3;
-
-    if (currentAlgorithm == Algorithm::selesnick)
-    {
-        selesnick_deff();
-        selesnick_getf();
+    // the patch part of the tables is usually ready, only the note's pitch and level are left
+    if (modeTable != nullptr && modeTable->patch == patch)
+        loadModeTable(*modeTable);
+    else
+        computePatchTables(patch);
 
-        selesnick_getSigma(ftau, fp);
-        selesnick_getw(fp);
-        selesnick_getK();
-    }
-    else if (currentAlgorithm == Algorithm::rabenstein)
-    {
-        rabenstein_getCoefficients(ftau, fp);
-        rabenstein_getw();
-        rabenstein_getK();
-    }
-    findmax();
+    computeNoteTables(patch);
     initDecayampn();
 
     t = 0;
@@ -801,6 +1849,15 @@ void SynthVoice::startNote(int midiNoteNumber, float velocity, SynthesiserSound
     trig = true;
     setKeyDown(true);
 
+    // other sounding voices give up part of their share at their next block
+    if (modeBudget != nullptr && !countedInBudget)
+    {
+        modeBudget->numSoundingVoices++;
+        countedInBudget = true;
+    }
+
+    if (voiceAllocator != nullptr) voiceAllocator->noteStarted(voiceSlot);
+
     prepareActiveModes();
 }
 
@@ -811,6 +1868,8 @@ void SynthVoice::stopNote(float /*velocity*/, bool allowTailOff)
     {
         trig = false;
         dur = 0;
+        leaveModeBudget();
+        if (voiceAllocator != nullptr) voiceAllocator->noteStopped(voiceSlot);
         clearCurrentNote();
     }
     else
@@ -834,6 +1893,7 @@ void SynthVoice::stopNote(float /*velocity*/, bool allowTailOff)
             {
                 rabenstein_getCoefficients(_tau, p);
             }
+            validStages &= ~dampingStage;  // computed for the release, not the patch
             updateActiveDecays();
         }
         setKeyDown(false);
@@ -867,41 +1927,46 @@ void SynthVoice::channelPressureChanged(int /*newChannelPressureValue*/)
 //==================================
 void SynthVoice::renderNextBlock(AudioBuffer<float> &outputBuffer, int startSample, int numSamples)
 {
-    if (!trig) return;
-
-    synthesizeBlock(numSamples);
-
-    // copy to output
-    for (int channel = 0; channel < outputBuffer.getNumChannels(); channel++)
-    {
-        float* outData = outputBuffer.getWritePointer(channel, startSample);
-        for (int s = 0; s < numSamples; s++)
-        {
-            outData[s] += (float)(buffer[s] * mainVolume);
-        }
-    }
-
-    advanceTime(numSamples);
+    render(outputBuffer, startSample, numSamples);
 }
 
 //==================================
 void SynthVoice::renderNextBlock(AudioBuffer<double> &outputBuffer, int startSample, int numSamples)
 {
-    if (!trig) return;
-
-    synthesizeBlock(numSamples);
+    render(outputBuffer, startSample, numSamples);
+}
 
-    // copy to output
-    for (int channel = 0; channel < outputBuffer.getNumChannels(); channel++)
+template <typename SampleType>
+void SynthVoice::render(AudioBuffer<SampleType> &outputBuffer, int startSample, int numSamples)
+{
+    // while the modulated knobs glide, the block is cut at the control rate
+    for (int done = 0; done < numSamples && trig; )
     {
-        double* outData = outputBuffer.getWritePointer(channel, startSample);
-        for (int s = 0; s < numSamples; s++)
+        int blockSize = numSamples - done;
+        modulating = updateModulation();
+        if (modulating) blockSize = jmin(blockSize, MODULATION_INTERVAL);
+
+        synthesizeBlock(blockSize);
+
+        // copy to output
+        for (int channel = 0; channel < outputBuffer.getNumChannels(); channel++)
         {
-            outData[s] += buffer[s] * mainVolume;
+            SampleType* outData = outputBuffer.getWritePointer(channel, startSample + done);
+            for (int s = 0; s < blockSize; s++)
+            {
+                outData[s] += SampleType(buffer[s] * mainVolume);
+            }
         }
+
+        advanceTime(blockSize);
+        done += blockSize;
     }
 
-    advanceTime(numSamples);
+    // what stealing the quietest voice goes by, a pass over the active modes that the other
+    // criteria don't need (may run on a render pool thread, like noteStopped() and
+    // leaveModeBudget() above: only this voice's slot and the atomic count change)
+    if (trig && voiceAllocator != nullptr && voiceAllocator->getStealing() == VoiceStealing::quietest)
+        voiceAllocator->setEnergy(voiceSlot, float(getRemainingEnergy()));
 }
 
 //==================================
@@ -913,40 +1978,209 @@ void SynthVoice::setCurrentPlaybackSampleRate(double newRate)
     if (currentAlgorithm == Algorithm::selesnick)
     {
         selesnick_getSigma(_tau, p);
-        selesnick_getw(p);
+        selesnick_getwTerms(p);
     }
     else if (currentAlgorithm == Algorithm::rabenstein)
     {
         rabenstein_getCoefficients(_tau, p);
-        rabenstein_getw();
+        rabenstein_getwTerms(_tau, p);
     }
+    validStages &= ~(dampingStage | frequencyStage);
+    getw();
     updateActiveDecays();
 }
 //==================================
-double SynthVoice::getSampleRate() const
+void SynthVoice::setSinglePrecision(bool shouldUseFloat)
 {
-    return sr;
+    singlePrecision = shouldUseFloat;
 }
 
-//==================================
-bool SynthVoice::isPlayingButReleased() const
+void SynthVoice::setEnvelopeEvaluation(EnvelopeEvaluation newEvaluation)
 {
-    return (trig && !isKeyDown());
+    envelopeEvaluation = newEvaluation;
 }
 
 //==================================
-bool SynthVoice::wasStartedBefore(const SynthesiserVoice& other) const
+int SynthVoice::getNumModes() const
 {
-    SynthesiserVoice& otherRef = const_cast<SynthesiserVoice&>(other);
-    try
-    {
-        SynthVoice& otherVoice = dynamic_cast<SynthVoice&>(otherRef);
+    return getNumModes(m1, m2, m3, dim + 1);
+}
 
-        // equal sign is very important for voice removal (to determine whether the current voice is the oldest)
-        return (t >= otherVoice.t);
-    }
-    catch (bad_cast e)
+int SynthVoice::getNumModes(int m1, int m2, int m3, int dimensions)
+{
+    int maxIndex = 0;
+    if (dimensions >= 1) maxIndex = m1;
+    if (dimensions >= 2) maxIndex *= m2;
+    if (dimensions >= 3) maxIndex *= m3;
+    return maxIndex;
+}
+
+void SynthVoice::reserveModes(int numModes)
+{
+    allocateModes(numModes);
+    commitModes();
+    freeRetiredModes();
+}
+
+// the new storage is written once here, so that the audio thread doesn't pay for the page faults
+// the first time a vector grows into it. The active tables keep their size, the coefficient
+// tables span the whole capacity
+template <typename T>
+void SynthVoice::allocateModeTable(std::vector<T>& table, size_t capacity, bool active)
+{
+    auto grown = std::make_shared<std::vector<T>>(capacity);
+    pendingModeSwaps.push_back([this, &table, grown, active]
     {
-        return false;
-    }
+        size_t size = table.size();
+        size_t live = (active ? size : jmin(size, size_t(getNumModes())));
+        std::copy(table.begin(), table.begin() + live, grown->begin());
+        if (active) grown->resize(size);  // shrinking never reallocates
+        table.swap(*grown);
+    });
+}
+
+void SynthVoice::allocateModes(int numModes)
+{
+    freeRetiredModes();
+    pendingModeSwaps.clear();
+    pendingModeCapacity = numModes;
+    if (numModes <= modeCapacity) return;
+
+    size_t n = size_t(numModes);
+
+    // coefficient tables
+    allocateModeTable(sigma, n, false);
+    allocateModeTable(alpha, n, false);
+    allocateModeTable(omegaScale, n, false);
+    allocateModeTable(omegaOffset, n, false);
+    allocateModeTable(modeGain, n, false);
+    allocateModeTable(mode_rejected, n, false);
+    allocateModeTable(yi, n, false);
+    allocateModeTable(knd, n, false);
+    allocateModeTable(omega, n, false);
+    allocateModeTable(decayamp, n, false);
+    allocateModeTable(decayampn, n, false);
+    allocateModeTable(axisTerm23, n, false);  // never more entries than modes
+    allocateModeTable(axisDecay23, n, false);
+
+    // active modes, so that prepareActiveModes() never reallocates
+    allocateModeTable(activePhases, n, true);
+    allocateModeTable(activeIncrements, n, true);
+    allocateModeTable(activeGains, n, true);
+    allocateModeTable(activeDecays, n, true);
+    allocateModeTable(activeEnvStates, n, true);
+    allocateModeTable(activePeriodCount, n, true);
+    allocateModeTable(activeModeIndex, n, true);
+    allocateModeTable(activeKeep, n, true);
+    allocateModeTable(activeScores, n, true);
+    allocateModeTable(rankedScores, n, true);
+
+    allocateModeTable(blockIncrements, n, true);
+    allocateModeTable(blockGains, n, true);
+    allocateModeTable(blockDecays, n, true);
+    allocateModeTable(blockIncrementSteps, n, true);
+    allocateModeTable(blockIncrementStepFractions, n, true);
+    allocateModeTable(activeDecayPowers, n * ModeBank::envelopeChunk, true);
+    allocateModeTable(activeChunkDecays, n, true);
+    allocateModeTable(activeOscRe, n, true);
+    allocateModeTable(activeOscIm, n, true);
+    allocateModeTable(activeRotorRe, n, true);
+    allocateModeTable(activeRotorIm, n, true);
+    allocateModeTable(floatGains, n, true);
+    allocateModeTable(floatDecays, n, true);
+    allocateModeTable(floatEnvStates, n, true);
+    allocateModeTable(bandIncrements, n, true);
+    allocateModeTable(bandDecays, n, true);
+}
+
+void SynthVoice::commitModes()
+{
+    if (pendingModeSwaps.empty()) return;
+
+    for (auto& swapTable : pendingModeSwaps)
+        swapTable();
+    modeCapacity = pendingModeCapacity;
+
+    // moved, so that nothing is freed here
+    retiredModeSwaps.swap(pendingModeSwaps);
+}
+
+void SynthVoice::freeRetiredModes()
+{
+    retiredModeSwaps.clear();
+}
+
+void SynthVoice::reserveBlockSize(int numSamples)
+{
+    // the sizes synthesizeBlock() and the kernels otherwise grow these to on first use
+    size_t scratchSize = jmax(ModeBank::getScratchSize(numSamples),
+                              ModeBank::getScratchSize(jmax(numSamples, BandUpsampler::prerollSamples)
+                                                       + 2*BandUpsampler::halfLength));
+    if (buffer.size() < (size_t)numSamples)
+        buffer.resize(numSamples);
+    if (modeBankScratch.size() < scratchSize)
+        modeBankScratch.resize(scratchSize);
+    if (floatBuffer.size() < (size_t)numSamples)
+        floatBuffer.resize(numSamples);
+    if (modeBankScratchFloat.size() < ModeBank::getFloatScratchSize(numSamples))
+        modeBankScratchFloat.resize(ModeBank::getFloatScratchSize(numSamples));
+    multiratePreroll.resize(BandUpsampler::prerollSamples);
+    bandUpsampler.reserve(jmax(numSamples, BandUpsampler::prerollSamples));
+}
+
+//==================================
+void SynthVoice::setOscillatorEngine(OscillatorEngine newEngine)
+{
+    // switching engines mid-note is fine, the phasors get re-seeded from the fixed-point state
+    oscillatorEngine = newEngine;
+}
+
+void SynthVoice::setModeCullThreshold(double thresholdDb)
+{
+    // anything at or below -200 dB disables culling
+    modeCullThreshold = Decibels::decibelsToGain(thresholdDb, -200.0);
+}
+
+void SynthVoice::setModeBudget(ModeBudget* newBudget)
+{
+    if (newBudget != modeBudget) countedInBudget = false;
+    modeBudget = newBudget;
+}
+
+void SynthVoice::setSpectralModeThreshold(int numModes)
+{
+    spectralModeThreshold = numModes;
+}
+
+void SynthVoice::setMultirate(bool shouldUseMultirate)
+{
+    multirate = shouldUseMultirate;
+}
+
+int SynthVoice::getNumActiveModes() const
+{
+    return trig ? int(activePhases.size()) : 0;
+}
+
+//==================================
+uint64_t SynthVoice::getNumStagesComputed() const
+{
+    return numStagesComputed;
+}
+
+uint64_t SynthVoice::getNumStagesSkipped() const
+{
+    return numStagesSkipped;
+}
+
+double SynthVoice::getSampleRate() const
+{
+    return sr;
+}
+
+//==================================
+bool SynthVoice::isPlayingButReleased() const
+{
+    return (trig && !isKeyDown());
 }
+
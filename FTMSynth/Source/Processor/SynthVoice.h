@@ -27,49 +27,182 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 #include <JuceHeader.h>
 #include "SynthSound.h"
-
-#define MAX_M1  20
-#define MAX_M2  20
-#define MAX_M3  20
+#include "ModeBank.h"
+#include "SpectralModeBank.h"
+#include "BandUpsampler.h"
+#include "PatchParams.h"
+
+#define MAX_M1  64  // parameter ranges, the mode tables are sized from the actual values
+#define MAX_M2  64
+#define MAX_M3  64
+#define MAX_MODES  32768  // per body (32^3), the largest axes shrink beyond. About 12 MB of tables per voice
+#define MAX_VOICES  16  // voices allocated up front, the "voices" parameter enables some of them
 #define SIN_LUT_RESOLUTION    0x40000
+#define SIN_LUT_SHIFT         14  // 32-bit phase >> SIN_LUT_SHIFT = LUT index
+#define COMPACT_SIN_LUT_BITS  11  // 2048-entry interpolated table
 
 enum Algorithm {
     selesnick, rabenstein
 };
 
+// how the mode oscillators are generated (see ModeBank)
+enum class OscillatorEngine {
+    lookupTable,        // truncated reads into sinLUT
+    phasor,             // complex rotation, no table
+    interpolatedTable   // linear interpolation into compactSinLUT
+};
+
+// how the lookup-table engine evaluates the mode envelopes
+enum class EnvelopeEvaluation {
+    recursive,        // amp *= decay every sample
+    blockExponential  // amp * decay^k from precomputed powers (see ModeBank::renderBlockExponential)
+};
+
+#ifndef FTM_DEFAULT_ENVELOPE_EVALUATION
+ #define FTM_DEFAULT_ENVELOPE_EVALUATION  EnvelopeEvaluation::recursive
+#endif
+
+#ifndef FTM_DEFAULT_OSCILLATOR_ENGINE
+ #define FTM_DEFAULT_OSCILLATOR_ENGINE  OscillatorEngine::lookupTable
+#endif
+
+#define PHASOR_RENORM_INTERVAL  4096  // samples between two re-seeds of the phasors
+
+#ifndef FTM_DEFAULT_SINGLE_PRECISION
+ #define FTM_DEFAULT_SINGLE_PRECISION  0  // 1 = render the lookup-table modes in float
+#endif
+
+#ifndef FTM_DEFAULT_MODE_BUDGET
+ #define FTM_DEFAULT_MODE_BUDGET  0  // max mode oscillators across all voices (0 = unlimited)
+#endif
+
+#ifndef FTM_DEFAULT_SPECTRAL_MODE_THRESHOLD
+ #define FTM_DEFAULT_SPECTRAL_MODE_THRESHOLD  0  // active modes from which a voice renders by inverse FFT (0 = never)
+#endif
+
+#ifndef FTM_DEFAULT_MULTIRATE
+ #define FTM_DEFAULT_MULTIRATE  0  // 1 = render the low modes at sr/2, sr/4 ... (see BandUpsampler)
+#endif
+
+#define MODULATION_INTERVAL  32  // samples between two updates of the knobs modulating a sounding note
+
+#ifndef FTM_MODULATION_SMOOTHING_MS
+ #define FTM_MODULATION_SMOOTHING_MS  20.0  // time constant of the glide towards the modulated knobs
+#endif
+
+#define MULTIRATE_MIN_SAVED_MODES  16  // full-rate oscillators the low bands must save to pay for the interpolators
+
+#ifndef FTM_DEFAULT_MODE_CULL_DB
+ #define FTM_DEFAULT_MODE_CULL_DB  -120.0  // modes quieter than this (relative to the peak) are dropped
+#endif
+
+
+// processor-wide cap on the number of mode oscillators, shared by all the voices
+// (the count is atomic since voices may render on VoiceRenderPool's threads)
+struct ModeBudget
+{
+    int maxModes = 0;  // 0 = unlimited
+    std::atomic<int> numSoundingVoices { 0 };
+
+    // number of modes a single voice may render right now
+    size_t getShare() const
+    {
+        if (maxModes <= 0) return SIZE_MAX;
+        return size_t(jmax(1, maxModes / jmax(1, numSoundingVoices.load())));
+    }
+};
+
+
+class NoteTableCache;
+class VoiceAllocator;
+
+
+// The part of a voice's mode tables that only depends on the patch, not on the note's pitch and
+// velocity. Computed off the audio thread by ModeTablePreparer, read-only once published.
+struct ModeTable
+{
+    // what the tables are computed from, a voice only uses tables with the same patch as its note
+    struct Patch
+    {
+        Algorithm algorithm = selesnick;
+        int dim = 0, m1 = 0, m2 = 0, m3 = 0;
+        double d = 0, a = 0, a2 = 0;
+        double r1 = 0, r2 = 0, r3 = 0;
+        double tau = 0, p = 0;
+        double sampleRate = 0;
+
+        bool operator==(const Patch&) const = default;
+    };
+
+    Patch patch;
+    std::vector<double> damping;      // sigma (Selesnick) or alpha (Rabenstein)
+    std::vector<double> decayamp;
+    std::vector<double> omegaScale;   // omega^2 = fomega^2 * omegaScale + omegaOffset
+    std::vector<double> omegaOffset;
+    std::vector<double> modeGain;
+    double fN = 0;
+};
+
 
 class SynthVoice : public SynthesiserVoice
 {
 public:
+    SynthVoice();
+
     bool canPlaySound(SynthesiserSound* sound) override;
 
+    // Disabled voices never get a note, so that the polyphony can change without adding or
+    // removing voices from the Synthesiser. Only change it on the audio thread.
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const;
+
     //==================================
     static void computeSinLUT();
 
-    void getcusParam(std::atomic<float>* algo,
-                     std::atomic<float>* volume,
-                     std::atomic<float>* attack,
-                     std::atomic<float>* pitch,
-                     std::atomic<float>* kbTrack,
-                     std::atomic<float>* _tau,
-                     std::atomic<float>* gate,
-                     std::atomic<float>* rel,
-                     std::atomic<float>* p,
-                     std::atomic<float>* pGate,
-                     std::atomic<float>* ring,
-                     std::atomic<float>* dispersion,
-                     std::atomic<float>* alpha1,
-                     std::atomic<float>* alpha2,
-                     std::atomic<float>* x,
-                     std::atomic<float>* y,
-                     std::atomic<float>* z,
-                     std::atomic<float>* modesX,
-                     std::atomic<float>* modesY,
-                     std::atomic<float>* modesZ,
-                     std::atomic<float>* dimensions);
+    // Takes the parameters of the next notes (and the ones acting on sounding notes) from params,
+    // if they changed since the last call
+    void setPatchParams(const PatchParams& params);
+
+    // number of modes of a body with these sizes (dimensions from 1 to 3)
+    static int getNumModes(int m1, int m2, int m3, int dimensions);
+
+    // Grows the mode tables to hold numModes modes (never shrinks them).
+    // Allocates, so it must not be called while the voice is rendering.
+    void reserveModes(int numModes);
+
+    // reserveModes() for a voice that may be rendering: allocateModes() builds the larger tables
+    // off the audio thread, commitModes() swaps them in under the callback lock (it only copies
+    // the live part of the current ones), and freeRetiredModes() frees the old ones afterwards
+    void allocateModes(int numModes);
+    void commitModes();
+    void freeRetiredModes();
+
+    // Sizes the rendering scratch buffers for blocks of up to numSamples samples.
+    // Allocates, so it must not be called while the voice is rendering.
+    void reserveBlockSize(int numSamples);
+
+    // Patch the next note will play, from the last setPatchParams() values
+    ModeTable::Patch getNextPatch(double sampleRate) const;
+
+    // Computes the patch part of the mode tables into table (used by ModeTablePreparer, off the audio thread)
+    void computeModeTable(const ModeTable::Patch& patch, ModeTable& table);
+
+    // Tables startNote() copies instead of computing them when their patch matches the note's.
+    // They must stay alive until the next call.
+    void setModeTable(const ModeTable* table);
+
+    // Per-key tables shared by the voices (nullptr = none), only touched from startNote()
+    void setNoteTableCache(NoteTableCache* cache);
+
+    // Where the voice reports its note-ons and energy (nullptr = nowhere), as voice number slot
+    void setVoiceAllocator(VoiceAllocator* allocator, int slot);
 
     //==================================
     void startNote(int midiNoteNumber, float velocity, SynthesiserSound *sound, int
@@ -87,40 +220,104 @@ public:
     void renderNextBlock(AudioBuffer<double> &outputBuffer, int startSample, int numSamples) override;
 
     void setCurrentPlaybackSampleRate(double newRate) override;
+    void setOscillatorEngine(OscillatorEngine newEngine);
+    void setSinglePrecision(bool shouldUseFloat);
+    void setEnvelopeEvaluation(EnvelopeEvaluation newEvaluation);
+    void setModeCullThreshold(double thresholdDb);
+    void setModeBudget(ModeBudget* newBudget);
+    void setSpectralModeThreshold(int numModes);
+    void setMultirate(bool shouldUseMultirate);
+    int getNumActiveModes() const;
+    // patch stages (see computePatchTables()) recomputed and skipped since the voice was created
+    uint64_t getNumStagesComputed() const;
+    uint64_t getNumStagesSkipped() const;
     double getSampleRate() const;
     bool isPlayingButReleased() const;
-    bool wasStartedBefore(const SynthesiserVoice& other) const;
 
 
 private:
     // Methods used for the Selesnick method
     void selesnick_deff();
     void selesnick_getf();
+    static void selesnick_project(const double* fx, int m, double* f);
     void selesnick_getSigma(double _tau, double p);
-    void selesnick_getw(double p);
-    void selesnick_getK();
+    double selesnick_getAxisTables(double _tau, double p);
+    void selesnick_getwTerms(double p);
+    void selesnick_getKTerms();
 
     // Methods used for the Rabenstein method
     void rabenstein_getCoefficients(double _tau, double _p);
-    void rabenstein_getw();
-    void rabenstein_getK();
+    void rabenstein_getAxisTables(double _tau, double _p, double& d1, double& d3);
+    void rabenstein_getwTerms(double _tau, double _p);
+    void rabenstein_getKTerms();
 
     // Common methods
+    static void getSineSequence(double theta, int count, double* output);
+    void applyPatch(const ModeTable::Patch& patch);
+    static uint32_t getChangedStages(const ModeTable::Patch& from, const ModeTable::Patch& to);
+    void computePatchTables(const ModeTable::Patch& patch);
+    void loadModeTable(const ModeTable& table);
+    void getw();
+    void getK();
+    void computeNoteTables(const ModeTable::Patch& patch);
+    int getNumModes() const;
+    int getAxisSize(int axis) const;
+    // output[i + m1*(j + m2*k)] = a1[i] + a2[j] + a3[k], over the axes in use
+    void outerSum(const double* a1, const double* a2, const double* a3, double* output) const;
+    // output[i + m1*(j + m2*k)] = a1[i] * a2[j] * a3[k], over the axes in use
+    void outerProduct(const double* a1, const double* a2, const double* a3, double* output) const;
     void findmax();
+    template <Algorithm algorithm> void findmaxFor();
     void initDecayampn();
     // Optimization methods
     void prepareActiveModes();
+    template <Algorithm algorithm> void prepareActiveModesFor();
     void updateActiveDecays();
+    bool updateModulation();
+    void modulateActiveModes(double _tau, double p);
+    void cullInaudibleModes();
+    void trimToModeBudget();
+    void compactActiveModes();
+    void leaveModeBudget();
+    double getRemainingEnergy() const;
+    void updateDecayPowers();
+    void updateSpectralModes();
+    void updateMultirateBands();
+    void leaveMultirate();
+    void swapActiveModes(size_t a, size_t b);
     // Synthesis methods
+    template <typename SampleType> void render(AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples);
     void synthesizeBlock(int numSamples);
+    template <Algorithm algorithm, bool hasAttack> void renderModes(int numSamples);
+    template <Algorithm algorithm> void synthesizeAttackBlock(int numSamples, double currentPitchMultiplier);
+    template <Algorithm algorithm> void synthesizePitchRampBlock(int numSamples, double startMultiplier,
+                                                                 double endMultiplier);
+    void synthesizePhasorBlock(int numSamples, double currentPitchMultiplier,
+                               const uint32_t* increments, const double* gains, const double* decays);
+    void synthesizeFloatBlock(int numSamples,
+                              const uint32_t* increments, const double* gains, const double* decays);
+    void synthesizeSpectralBlock(int numSamples,
+                                 const uint32_t* increments, const double* gains, const double* decays);
+    void synthesizeMultirateBlock(int numSamples,
+                                  const uint32_t* increments, const double* gains, const double* decays);
     void advanceTime(int numSamples);
 
 
     //==================================
     // Class members
     inline static double sinLUT[SIN_LUT_RESOLUTION];
+    inline static float sinLUTf[SIN_LUT_RESOLUTION];  // same table for the float kernels
+    inline static float compactSinLUT[(1 << COMPACT_SIN_LUT_BITS) + 1];  // +1 guard point for interpolation
+
+    using RenderFunction = void (SynthVoice::*)(int numSamples);
+    static const RenderFunction renderFunctions[2][2];
+    RenderFunction renderModesFn = nullptr;
 
+    uint64_t patchParamsVersion = 0;  // PatchParams::version last applied
     Algorithm currentAlgorithm, nextAlgorithm;
+    OscillatorEngine oscillatorEngine = FTM_DEFAULT_OSCILLATOR_ENGINE;
+    bool singlePrecision = FTM_DEFAULT_SINGLE_PRECISION;
+    EnvelopeEvaluation envelopeEvaluation = FTM_DEFAULT_ENVELOPE_EVALUATION;
     double mainVolume;
     double atk = 1.0, nextAtk;  // attack windowing (1.0 = hard, 0.0 = soft)
 
@@ -129,9 +326,10 @@ private:
     bool bkbTrack;
     double fpitch;  // in semitones (plugin's pitch knob)
     double pitchBend;  // in octaves (pitch bend MIDI CC)
+    double renderedPitchMultiplier = 1.0;  // 2^pitchBend at the end of the last rendered block
 
     // time-related variables
-    bool trig;
+    bool trig = false;
     double t;
     double nsamp;
     double dur;  // in seconds
@@ -149,54 +347,116 @@ private:
 
     double r1, r2, r3;         // coordinates
 
+    // knobs that keep acting on a sounding note, gliding from their values at note-on
+    double modulatedPitch, modulatedD, modulatedA, modulatedA2, modulatedP;
+    double keyFomega;          // fomega without the pitch knob
+    double noteTau;            // sustain at note-on
+    bool modulating = false;   // the glide moved in the last control period
+
     int m1 = 5;      // shouldn't be bigger than MAX_M1
     int m2 = 5;      // shouldn't be bigger than MAX_M2
     int m3 = 5;      // shouldn't be bigger than MAX_M3
     int nextm1 = 5;  // shouldn't be bigger than MAX_M1
     int nextm2 = 5;  // shouldn't be bigger than MAX_M2
     int nextm3 = 5;  // shouldn't be bigger than MAX_M3
+    int modeCapacity = 0;  // size of the per-mode tables below, see reserveModes()
+    bool enabled = true;
+
+    // tables from allocateModes(), each swapped in by its function. Once committed, the functions
+    // hold the old storage until freeRetiredModes()
+    std::vector<std::function<void()>> pendingModeSwaps;
+    std::vector<std::function<void()>> retiredModeSwaps;
+    int pendingModeCapacity = 0;
+    template <typename T>
+    void allocateModeTable(std::vector<T>& table, size_t capacity, bool active);
+
+    // shrinks the largest axis of patch until the body has at most maxModes modes
+    static void shrinkToFit(ModeTable::Patch& patch, int maxModes);
 
-    int dim, nextDim;
+    int dim = 2, nextDim = 2;
 
 
     // ===== Variables used for the Selesnick method
-    int tau = 300;
+    static constexpr int tau = 300;  // intervals of the excitation integral
+    inline static double excitationSin[2 * tau];  // sin(n*pi/tau), the sine basis of selesnick_getf()
 
-    double fx1[301];  // tau
-    double fx2[301];
-    double fx3[301];
+    double fx1[tau+1];
+    double fx2[tau+1];
+    double fx3[tau+1];
     double f1[MAX_M1];
     double f2[MAX_M2];
     double f3[MAX_M3];
 
+    // separable parts of the mode tables, one entry per mode number along each axis
+    double axisTerm1[MAX_M1];   // weighted squared mode numbers, summed over the axes
+    double axisTerm2[MAX_M2];
+    double axisTerm3[MAX_M3];
+    double axisDecay1[MAX_M1];  // decayamp factors, multiplied over the axes
+    double axisDecay2[MAX_M2];
+    double axisDecay3[MAX_M3];
+    double axisGain1[MAX_M1];   // excitation and pickup factors, multiplied over the axes
+    double axisGain2[MAX_M2];
+    double axisGain3[MAX_M3];
+    std::vector<double> axisTerm23;   // axes 2 and 3 folded together, see modulateActiveModes()
+    std::vector<double> axisDecay23;
+
     // mode decay/damping factors
-    double sigma[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<double> sigma;
 
 
     // ===== Variables used for the Rabenstein method
-    double alpha[MAX_M1*MAX_M2*MAX_M3];
-    double beta[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<double> alpha;
 
-    bool mode_rejected[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<uint8_t> mode_rejected;
 
     double fN;
 
-    double yi[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<double> yi;
 
 
     // ===== Common variables
     // mode magnitudes
-    double knd[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<double> knd;
 
     // mode frequencies
-    double omega[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<double> omega;
+    std::vector<double> omegaScale;   // omega^2 = fomega^2 * omegaScale + omegaOffset
+    std::vector<double> omegaOffset;
+    std::vector<double> modeGain;     // knd * omega (Selesnick) or knd (Rabenstein), no pitch dependency
+
+    // Stages of the patch tables, as bits of validStages
+    enum PatchStage : uint32_t
+    {
+        excitationStage = 1 << 0,  // f1/f2/f3 (Selesnick only)
+        dampingStage    = 1 << 1,  // sigma or alpha, decayamp, fN and the axis terms
+        frequencyStage  = 1 << 2,  // omegaScale, omegaOffset
+        gainStage       = 1 << 3,  // modeGain
+        allStages       = (1 << 4) - 1
+    };
+    ModeTable::Patch computedPatch;  // what the valid stages were last computed for
+    uint32_t validStages = 0;
+    uint64_t numStagesComputed = 0;
+    uint64_t numStagesSkipped = 0;
+
+    const ModeTable* modeTable = nullptr;  // shared patch tables, see setModeTable()
+    NoteTableCache* noteTableCache = nullptr;
 
     // mode decay factors, sample-rate dependant
-    double decayamp[MAX_M1*MAX_M2*MAX_M3];
-    double decayampn[MAX_M1*MAX_M2*MAX_M3];
+    std::vector<double> decayamp;
+    std::vector<double> decayampn;
 
     double maxh = 1;  // the max of h for each set of parameters
 
+    // linear amplitude below which a decaying mode is culled, relative to the
+    // normalised peak level (the active gains are already divided by maxh)
+    double modeCullThreshold = pow(10.0, FTM_DEFAULT_MODE_CULL_DB / 20.0);
+
+    ModeBudget* modeBudget = nullptr;
+    bool countedInBudget = false;  // this voice is part of modeBudget->numSoundingVoices
+
+    VoiceAllocator* voiceAllocator = nullptr;
+    int voiceSlot = 0;
+
     // Optimization structures
     std::vector<uint32_t> activePhases;
     std::vector<uint32_t> activeIncrements;
@@ -204,6 +464,67 @@ private:
     std::vector<double> activeDecays;
     std::vector<double> activeEnvStates;
     std::vector<uint8_t> activePeriodCount;
+    std::vector<int> activeModeIndex;  // index of each active mode in the coefficient tables
+    std::vector<uint8_t> activeKeep;   // modes flagged for compactActiveModes()
+    std::vector<double> activeScores;  // scratch for the energy ranking
+    std::vector<double> rankedScores;
+    bool attackDone = true;  // every active mode is past the attack window
+    size_t numModesAtNyquist = 0;  // modes a modulation pushed to Nyquist, muted until they come back
+
+    // per-block kernel inputs (pitch bend applied)
+    std::vector<uint32_t> blockIncrements;
+    std::vector<double> blockGains;
+    std::vector<double> blockDecays;
+    std::vector<int32_t> blockIncrementSteps;  // per-sample increment change during a pitch glide
+    std::vector<uint32_t> blockIncrementStepFractions;  // and its fractional part, in 1/2^32
+
+    // block-exponential envelopes: decay^k for k in [0, ModeBank::envelopeChunk) per mode,
+    // and decay^envelopeChunk, rebuilt whenever activeDecays changes
+    std::vector<double> activeDecayPowers;
+    std::vector<double> activeChunkDecays;
+    bool decayPowersValid = false;
+
+    // phasor engine state: z = env * e^(i*phase) and rotor = decay * e^(i*inc)
+    std::vector<double> activeOscRe;
+    std::vector<double> activeOscIm;
+    std::vector<double> activeRotorRe;
+    std::vector<double> activeRotorIm;
+    bool phasorsValid = false;  // z matches activePhases/activeEnvStates
+    bool rotorsValid = false;   // rotors match the increments/decays below
+    double rotorPitchMultiplier = 1.0;
+    int samplesSinceRenorm = 0;
+
+    // single-precision kernel inputs, refreshed every block from the double state
+    std::vector<float> floatGains;
+    std::vector<float> floatDecays;
+    std::vector<float> floatEnvStates;
+    std::vector<float> floatBuffer;
+    std::vector<float> modeBankScratchFloat;
+
+    // inverse-FFT rendering of the slowly decaying modes, for voices with many modes.
+    // While it is on, the active* arrays hold the modes left to the oscillators first:
+    // [0, numOscillatorModes) on ModeBank, [numOscillatorModes, size) on spectralModes
+    SpectralModeBank spectralModes;
+    int spectralModeThreshold = FTM_DEFAULT_SPECTRAL_MODE_THRESHOLD;
+    bool spectralActive = false;
+    bool spectralPartitionValid = false;
+    size_t numOscillatorModes = 0;
+
+    // multirate rendering of the low modes. While it is on, the active* arrays are sorted by
+    // octave band: band b = [bandStart[b], bandStart[b+1]) is rendered at sr / 2^b
+    BandUpsampler bandUpsampler;
+    bool multirate = FTM_DEFAULT_MULTIRATE;
+    bool multirateActive = false;
+    bool multiratePrimed = false;  // the low bands have been run up to the current sample
+    int numBands = 1;
+    size_t bandStart[BandUpsampler::maxBands + 1] = {};
+    std::vector<uint32_t> bandIncrements;  // per band sample
+    std::vector<double> bandDecays;
+    std::vector<double> multiratePreroll;
 
     std::vector<double> buffer;
+    std::vector<double> modeBankScratch;
+
+    friend class SynthVoiceTests;
+    friend class ModeBankTests;
 };
@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+    VoiceAllocator.cpp
+    Created: 17 Oct 2026 12:28:35pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "VoiceAllocator.h"
+
+#include <cmath>
+
+
+void VoiceAllocator::setNumVoices(int numVoices)
+{
+    slots.assign(numVoices, Slot());
+}
+
+void VoiceAllocator::setEnabled(int slot, bool shouldBeEnabled)
+{
+    slots[slot].enabled = shouldBeEnabled;
+}
+
+void VoiceAllocator::noteStarted(int slot)
+{
+    slots[slot].noteOn = ++noteOnCount;
+    slots[slot].energy = HUGE_VALF;  // nothing rendered yet, it's the loudest until its first block
+    slots[slot].sounding = true;
+}
+
+void VoiceAllocator::noteStopped(int slot)
+{
+    slots[slot].energy = 0;
+    slots[slot].sounding = false;
+}
+
+void VoiceAllocator::setEnergy(int slot, float energy)
+{
+    slots[slot].energy = energy;
+}
+
+void VoiceAllocator::setStealing(VoiceStealing newStealing)
+{
+    stealing = newStealing;
+}
+
+VoiceStealing VoiceAllocator::getStealing() const
+{
+    return stealing;
+}
+
+int VoiceAllocator::findVoiceToSteal(VoiceStealing criterion) const
+{
+    int found = -1;
+    for (int i = 0; i < int(slots.size()); i++)
+    {
+        const Slot& slot = slots[i];
+        if (!slot.sounding || !slot.enabled) continue;
+
+        if (found < 0
+            || (criterion == VoiceStealing::oldest && slot.noteOn < slots[found].noteOn)
+            || (criterion == VoiceStealing::quietest && slot.energy < slots[found].energy))
+            found = i;
+    }
+    return found;
+}
+
+//==================================
+StealingSynthesiser::StealingSynthesiser(const VoiceAllocator& voiceAllocator)
+    : allocator(voiceAllocator)
+{
+}
+
+SynthesiserVoice* StealingSynthesiser::findVoiceToSteal(SynthesiserSound* soundToPlay, int midiChannel,
+                                                        int midiNoteNumber) const
+{
+    if (allocator.getStealing() == VoiceStealing::quietest)
+    {
+        int slot = allocator.findVoiceToSteal(VoiceStealing::quietest);
+        if (slot >= 0 && slot < getNumVoices())
+            return getVoice(slot);
+    }
+    return Synthesiser::findVoiceToSteal(soundToPlay, midiChannel, midiNoteNumber);
+}
+
+void StealingSynthesiser::setRenderPool(VoiceRenderPool* pool)
+{
+    renderPool = pool;
+}
+
+void StealingSynthesiser::renderVoices(AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+{
+    if (renderPool != nullptr && renderPool->render(*this, outputAudio, startSample, numSamples))
+        return;
+    Synthesiser::renderVoices(outputAudio, startSample, numSamples);
+}
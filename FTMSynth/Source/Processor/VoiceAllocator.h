@@ -0,0 +1,104 @@
+/*
+  ==============================================================================
+
+    VoiceAllocator.h
+    Created: 17 Oct 2026 12:28:35pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <JuceHeader.h>
+#include "VoiceRenderPool.h"
+
+enum class VoiceStealing {
+    oldest,    // the voice whose note started first
+    quietest,  // the voice with the least energy left
+};
+
+#ifndef FTM_DEFAULT_VOICE_STEALING
+ #define FTM_DEFAULT_VOICE_STEALING  VoiceStealing::oldest
+#endif
+
+
+// Note-on order and energy of every voice, side by side in one array, so that choosing
+// the voice to steal or to cut is a single pass over the voices.
+//
+// Slot i is the Synthesiser's voice i. setNumVoices() runs before anything renders, the rest
+// doesn't allocate. noteStopped() and setEnergy() are also called by voices rendering on
+// VoiceRenderPool's threads: each voice only writes its own slot, and the slots are read by
+// findVoiceToSteal() on the audio thread once the pool has finished the block. The other
+// functions are for the audio thread.
+class VoiceAllocator
+{
+public:
+    void setNumVoices(int numVoices);
+
+    void setEnabled(int slot, bool shouldBeEnabled);
+    void noteStarted(int slot);
+    void noteStopped(int slot);
+    void setEnergy(int slot, float energy);
+
+    void setStealing(VoiceStealing newStealing);
+    VoiceStealing getStealing() const;
+
+    // Sounding enabled voice to give up first, or -1 if none is sounding
+    int findVoiceToSteal(VoiceStealing criterion) const;
+
+private:
+    // one cache line each, so that voices rendering on different threads don't share one
+    struct alignas(64) Slot
+    {
+        uint64_t noteOn = 0;  // note-on count when the note started
+        float energy = 0;     // remaining energy at the end of the last block
+        bool sounding = false;
+        bool enabled = true;
+    };
+
+    std::vector<Slot> slots;
+    uint64_t noteOnCount = 0;
+    VoiceStealing stealing = FTM_DEFAULT_VOICE_STEALING;
+};
+
+
+// Synthesiser that asks the allocator which voice to steal in VoiceStealing::quietest mode,
+// and keeps JUCE's choice (the oldest voice, sparing the lowest and highest held notes) otherwise.
+// It also hands the voices to a VoiceRenderPool when one is set.
+class StealingSynthesiser : public Synthesiser
+{
+public:
+    explicit StealingSynthesiser(const VoiceAllocator& allocator);
+
+    // Pool rendering the voices in parallel (nullptr = the audio thread renders them all)
+    void setRenderPool(VoiceRenderPool* pool);
+
+protected:
+    SynthesiserVoice* findVoiceToSteal(SynthesiserSound* soundToPlay, int midiChannel,
+                                       int midiNoteNumber) const override;
+    void renderVoices(AudioBuffer<float>& outputAudio, int startSample, int numSamples) override;
+
+private:
+    const VoiceAllocator& allocator;
+    VoiceRenderPool* renderPool = nullptr;
+};
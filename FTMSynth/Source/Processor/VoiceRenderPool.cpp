@@ -0,0 +1,235 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.cpp
+    Created: 17 Oct 2026 12:33:06pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#include "VoiceRenderPool.h"
+
+#include <algorithm>
+#include <thread>
+
+#if FTM_MODEBANK_X86
+ #include <immintrin.h>
+#endif
+
+
+VoiceRenderPool::VoiceRenderPool()
+{
+}
+
+VoiceRenderPool::~VoiceRenderPool()
+{
+    stop();
+}
+
+void VoiceRenderPool::prepare(int numWorkers, int maxBlockSize, int numChannels)
+{
+    stop();
+
+    for (auto& buffer : voiceBuffers)
+        buffer.setSize(numChannels, maxBlockSize);
+    bufferSize = maxBlockSize;
+    bufferChannels = numChannels;
+
+    // one core each, leaving the first one to the host and the OS
+    numWorkers = jmax(0, jmin(numWorkers, maxWorkers, SystemStats::getNumCpus() - 1));
+    numThreads = numWorkers + 1;
+    for (int i = 0; i < numWorkers; i++)
+    {
+        Worker* worker = workers.add(new Worker(*this, i + 1));
+        worker->setAffinityMask(uint32(1) << (i + 1));
+        worker->startRealtimeThread(Thread::RealtimeOptions());
+    }
+}
+
+void VoiceRenderPool::stop()
+{
+    for (auto* worker : workers)
+    {
+        worker->signalThreadShouldExit();
+        worker->notify();
+    }
+    for (auto* worker : workers)
+        worker->stopThread(1000);
+    workers.clear();
+    numThreads = 1;
+}
+
+bool VoiceRenderPool::render(const Synthesiser& synth, AudioBuffer<float>& output, int startSample, int numSamples)
+{
+    int numVoices = synth.getNumVoices();
+    if (workers.isEmpty() || numVoices > maxVoices || numSamples < minSamples || numSamples > bufferSize
+        || output.getNumChannels() > bufferChannels)
+        return false;
+
+    int numJobs = 0;
+    for (int i = 0; i < numVoices; i++)
+    {
+        SynthesiserVoice* voice = synth.getVoice(i);
+        rendered[i] = voice->isVoiceActive();
+        if (!rendered[i]) continue;
+
+        SynthVoice* myVoice = dynamic_cast<SynthVoice*>(voice);
+        jobs[numJobs++] = { voice, i, myVoice != nullptr ? myVoice->getNumActiveModes() : 0 };
+    }
+    if (numJobs < 2) return false;
+
+    // largest first, so that the small voices fill in the gaps at the end
+    std::sort(jobs, jobs + numJobs, [](const Job& a, const Job& b) { return a.numModes > b.numModes; });
+    jobSamples = numSamples;
+    jobChannels = output.getNumChannels();
+    jobsDone = 0;
+
+    // a new generation, so that a worker still looking at the last block's deques can't take anything
+    uint32_t generation = currentGeneration.load() + 1;
+    for (int thread = 0; thread < numThreads; thread++)
+    {
+        uint64_t count = 0;
+        for (int job = thread; job < numJobs; job += numThreads)
+            deques[thread].jobs[count++] = job;
+        deques[thread].range.store(uint64_t(generation) << 32 | count, std::memory_order_release);
+    }
+    currentGeneration.store(generation);
+
+    // the workers that went to sleep since the last block, the others are polling
+    for (int i = 0; i < jmin(workers.size(), numJobs - 1); i++)
+        if (workers[i]->sleeping.exchange(false))
+            workers[i]->notify();
+
+    runJobs(0, generation);
+    int spins = 0;
+    while (jobsDone.load(std::memory_order_acquire) < numJobs)  // voices a worker is still on
+        backOff(spins);
+
+    // in voice order, whoever rendered them
+    for (int i = 0; i < numVoices; i++)
+    {
+        if (!rendered[i]) continue;
+        for (int channel = 0; channel < jobChannels; channel++)
+            FloatVectorOperations::add(output.getWritePointer(channel, startSample),
+                                       voiceBuffers[i].getReadPointer(channel), numSamples);
+    }
+    return true;
+}
+
+// the thread's own deque first, then the others' starting from the next thread
+void VoiceRenderPool::runJobs(int thread, uint32_t generation)
+{
+    int victim = thread;
+    int job;
+    while (true)
+    {
+        if (!takeJob(deques[victim], generation, victim == thread, job))
+        {
+            victim = (victim + 1) % numThreads;
+            if (victim == thread) return;
+            continue;
+        }
+
+        const Job& current = jobs[job];
+        AudioBuffer<float> buffer(voiceBuffers[current.slot].getArrayOfWritePointers(), jobChannels, jobSamples);
+        buffer.clear();
+        current.voice->renderNextBlock(buffer, 0, jobSamples);
+
+        jobsDone.fetch_add(1, std::memory_order_release);
+    }
+}
+
+bool VoiceRenderPool::takeJob(Deque& deque, uint32_t generation, bool front, int& job)
+{
+    uint64_t range = deque.range.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint64_t first = (range >> 16) & 0xffff;
+        uint64_t end = range & 0xffff;
+        if ((range >> 32) != generation || first >= end) return false;
+
+        uint64_t next = (front ? range + (uint64_t(1) << 16) : range - 1);
+        if (deque.range.compare_exchange_weak(range, next, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            job = deque.jobs[front ? first : end - 1];
+            return true;
+        }
+    }
+}
+
+// a few pause hints while the other core is likely to be done soon, then yields it
+void VoiceRenderPool::backOff(int& spins)
+{
+    if (++spins <= 64)
+    {
+       #if FTM_MODEBANK_X86
+        _mm_pause();
+       #endif
+    }
+    else
+    {
+        std::this_thread::yield();
+    }
+}
+
+//==================================
+VoiceRenderPool::Worker::Worker(VoiceRenderPool& _pool, int _thread)
+    : Thread("FTMSynth voices " + String(_thread)),
+      pool(_pool),
+      thread(_thread)
+{
+}
+
+void VoiceRenderPool::Worker::run()
+{
+    // same floating point behaviour as processBlock(), so the voices render the same samples here
+    ScopedNoDenormals noDenormals;
+
+    uint32_t generation = pool.currentGeneration.load();
+    double idleSince = Time::getMillisecondCounterHiRes();
+    int spins = 0;
+    while (!threadShouldExit())
+    {
+        uint32_t next = pool.currentGeneration.load(std::memory_order_acquire);
+        if (next != generation)
+        {
+            generation = next;
+            pool.runJobs(thread, generation);
+            idleSince = Time::getMillisecondCounterHiRes();
+            spins = 0;
+        }
+        else if (Time::getMillisecondCounterHiRes() - idleSince < workerSpinMs)
+        {
+            backOff(spins);
+        }
+        else
+        {
+            // render() notifies the sleeping workers after publishing a block, so either it sees
+            // the flag or this sees the block
+            sleeping = true;
+            if (pool.currentGeneration.load() == generation && !threadShouldExit())
+                wait(-1);
+            sleeping = false;
+            idleSince = Time::getMillisecondCounterHiRes();
+            spins = 0;
+        }
+    }
+}
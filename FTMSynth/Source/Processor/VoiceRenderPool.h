@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.h
+    Created: 17 Oct 2026 12:33:06pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <JuceHeader.h>
+#include "SynthVoice.h"
+
+#ifndef FTM_DEFAULT_RENDER_THREADS
+ #define FTM_DEFAULT_RENDER_THREADS  0  // worker threads rendering voices next to the audio thread (0 = off)
+#endif
+
+
+// Renders the sounding voices of a block on pinned real-time worker threads, with the audio
+// thread taking its share, so that one instance with many heavy voices isn't capped by one core.
+//
+// Every voice renders into its own buffer, and the buffers are added to the output in voice
+// order once they are all done, which gives the same samples as rendering the voices one after
+// the other. The voices, sorted by active modes, are dealt round-robin to one deque per thread:
+// each thread renders its own from the largest down, then steals the smallest left in the others'.
+// This balances voices of very different sizes and never leaves the audio thread waiting on a
+// worker that hasn't woken up yet, it just takes that worker's voices.
+//
+// Idle workers poll for the next block for workerSpinMs before sleeping, so that the audio thread
+// only has to wake them (a system call) after a pause, not on every block.
+//
+// prepare() and stop() run on the message thread while nothing renders, render() on the audio thread.
+class VoiceRenderPool
+{
+public:
+    static constexpr int maxVoices = MAX_VOICES;
+    static constexpr int maxWorkers = 15;
+    static constexpr int minSamples = 16;  // shorter sub-blocks aren't worth waking the workers
+    static constexpr double workerSpinMs = 1.0;  // covers the sub-blocks of a block and small buffer sizes
+
+    VoiceRenderPool();
+    ~VoiceRenderPool();
+
+    // Starts numWorkers threads and sizes the voice buffers for blocks of up to maxBlockSize samples
+    void prepare(int numWorkers, int maxBlockSize, int numChannels);
+    void stop();
+
+    // Adds the sounding voices of synth to output, or returns false (having rendered nothing) if
+    // it's better left to the Synthesiser, e.g. when fewer than two voices are sounding
+    bool render(const Synthesiser& synth, AudioBuffer<float>& output, int startSample, int numSamples);
+
+private:
+    class Worker : public Thread
+    {
+    public:
+        Worker(VoiceRenderPool& pool, int thread);
+        void run() override;
+
+        std::atomic<bool> sleeping { false };  // in wait(), render() has to notify() it
+
+    private:
+        VoiceRenderPool& pool;
+        int thread;  // its deque
+    };
+
+    struct Job
+    {
+        SynthesiserVoice* voice;
+        int slot;     // voice index, i.e. its place in the sum
+        int numModes; // rendering cost estimate
+    };
+
+    // The jobs of one thread for the current block, taken from the front by that thread and from
+    // the back by the others
+    struct alignas(64) Deque
+    {
+        int jobs[maxVoices] = {};
+        // generation << 32 | front << 16 | back, empty when front == back
+        std::atomic<uint64_t> range { 0 };
+    };
+
+    void runJobs(int thread, uint32_t generation);
+    bool takeJob(Deque& deque, uint32_t generation, bool front, int& job);
+    static void backOff(int& spins);
+
+    OwnedArray<Worker> workers;
+    AudioBuffer<float> voiceBuffers[maxVoices];
+    int bufferSize = 0;
+    int bufferChannels = 0;
+    int numThreads = 1;  // the audio thread and the workers, one deque each
+
+    // the current block, written by the audio thread before it publishes the deques
+    Job jobs[maxVoices];
+    int jobSamples = 0;
+    int jobChannels = 0;
+    bool rendered[maxVoices] = {};
+
+    Deque deques[maxWorkers + 1];  // [0] is the audio thread's
+    std::atomic<uint32_t> currentGeneration { 0 };  // one per block, the workers wait for the next one
+    std::atomic<int> jobsDone { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VoiceRenderPool)
+};
@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    BandUpsamplerTests.cpp
+    Created: 17 Oct 2026 1:06:31pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#include <JuceHeader.h>
+#include <vector>
+#include "../Processor/BandUpsampler.h"
+
+
+class BandUpsamplerTests : public UnitTest
+{
+public:
+    BandUpsamplerTests() : UnitTest("BandUpsampler", "FTMSynth") {}
+
+    void initialise() override
+    {
+        BandUpsampler::computeFilter();
+    }
+
+    void runTest() override
+    {
+        beginTest("Constant bands come out at unity gain");
+        for (int numBands = 2; numBands <= BandUpsampler::maxBands; numBands++)
+        {
+            BandUpsampler upsampler;
+            upsampler.reserve(BandUpsampler::prerollSamples);
+            upsampler.reset(numBands);
+
+            auto renderBand = [](int, double* output, int numSamples)
+            {
+                for (int k = 0; k < numSamples; k++)
+                    output[k] += 1.0;
+            };
+            std::vector<double> output(BandUpsampler::prerollSamples, 0.0);
+            upsampler.process(output.data(), BandUpsampler::prerollSamples, renderBand);
+            std::fill(output.begin(), output.end(), 0.0);
+            upsampler.process(output.data(), BandUpsampler::prerollSamples, renderBand);
+
+            // every band but the full-rate one
+            expectWithinAbsoluteError(output.front(), double(numBands - 1), 1e-12);
+            expectWithinAbsoluteError(output.back(), double(numBands - 1), 1e-12);
+        }
+
+        beginTest("reserve() covers every block up to its size");
+        {
+            const int maxBlockSize = 512;
+            BandUpsampler upsampler;
+            upsampler.reserve(maxBlockSize);
+            upsampler.reset(BandUpsampler::maxBands);
+
+            const double* buffers[BandUpsampler::maxBands];
+            for (int b = 1; b < BandUpsampler::maxBands; b++)
+                buffers[b] = upsampler.levels[b].samples.data();
+
+            Random random = getRandom();
+            auto renderBand = [&random](int, double* output, int numSamples)
+            {
+                for (int k = 0; k < numSamples; k++)
+                    output[k] += random.nextDouble() - 0.5;
+            };
+            std::vector<double> output(maxBlockSize);
+            for (int block = 0; block < 1000; block++)
+                upsampler.process(output.data(), 1 + random.nextInt(maxBlockSize), renderBand);
+            upsampler.process(output.data(), maxBlockSize, renderBand);
+
+            for (int b = 1; b < BandUpsampler::maxBands; b++)
+                expect(upsampler.levels[b].samples.data() == buffers[b], "level " + String(b) + " reallocated");
+        }
+    }
+};
+
+static BandUpsamplerTests bandUpsamplerTests;
@@ -0,0 +1,52 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+    Created: 17 Oct 2026 12:50:25pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#include <JuceHeader.h>
+
+
+// Runs the unit tests, or only the benchmarks with --benchmarks.
+// Returns 1 if any of them failed.
+int main(int argc, char* argv[])
+{
+    bool benchmarks = false;
+    for (int i = 1; i < argc; i++)
+        if (String(argv[i]) == "--benchmarks")
+            benchmarks = true;
+
+    UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    for (auto& category : UnitTest::getAllCategories())
+        if ((category == "Benchmarks") == benchmarks)
+            runner.runTestsInCategory(category);
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); i++)
+        failures += runner.getResult(i)->failures;
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+/*
+  ==============================================================================
+
+    ModeBankBenchmark.cpp
+    Created: 17 Oct 2026 12:50:45pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#include <JuceHeader.h>
+#include <cmath>
+#include <utility>
+#include <vector>
+#include "TestVoice.h"
+
+
+// Timings of the mode-bank kernels, of the oscillator engines a voice renders with, and of the
+// inverse-FFT bank and the multirate path against the full-rate oscillators.
+// Run with --benchmarks, on an otherwise idle machine.
+class ModeBankBenchmark : public UnitTest
+{
+public:
+    ModeBankBenchmark() : UnitTest("ModeBank", "Benchmarks") {}
+
+    void runTest() override
+    {
+        beginTest("Kernels, 400 modes, 1 s at 48 kHz in 256-sample blocks");
+        {
+            std::vector<double> sinTable(SIN_LUT_RESOLUTION);
+            for (size_t i = 0; i < sinTable.size(); i++)
+                sinTable[i] = std::sin(2.0 * M_PI * double(i) / SIN_LUT_RESOLUTION);
+
+            const char* names[] = { "scalar", "SSE2", "AVX2" };
+            std::vector<double> scalarOutput;
+            for (int set = 0; set <= int(ModeBank::getInstructionSet()); set++)
+            {
+                std::vector<double> output;
+                double ms = timeKernel(ModeBank::InstructionSet(set), sinTable, output);
+                logMessage(String(names[set]) + ": " + String(ms, 2) + " ms");
+
+                if (set == 0)
+                    scalarOutput = output;
+                else
+                    expectLessThan(TestVoice::getMaxDifference(output, scalarOutput),
+                                   1e-12 * TestVoice::getPeak(scalarOutput),
+                                   "the SIMD kernels only reorder the sum of the modes");
+            }
+        }
+
+        beginTest("Oscillator engines, one voice, 1 s at 48 kHz in 256-sample blocks");
+        for (int dimensions = 1; dimensions <= 3; dimensions++)
+        {
+            std::vector<double> lookupTableOutput, phasorOutput;
+            double lookupTableMs = timeVoice(OscillatorEngine::lookupTable, dimensions, 20, false,
+                                             lookupTableOutput);
+            double phasorMs = timeVoice(OscillatorEngine::phasor, dimensions, 20, false, phasorOutput);
+            logMessage(String(dimensions) + "D, 20 modes per axis: lookup table "
+                       + String(lookupTableMs, 1) + " ms, phasor " + String(phasorMs, 1) + " ms");
+
+            // the phasors are exact, so this is the truncation error of sinLUT (about its step,
+            // 2pi / SIN_LUT_RESOLUTION = 2.4e-5, relative to the peak)
+            expectLessThan(TestVoice::getMaxDifference(phasorOutput, lookupTableOutput),
+                           2.0 * (2.0 * M_PI / SIN_LUT_RESOLUTION) * TestVoice::getPeak(lookupTableOutput));
+        }
+
+        beginTest("Oscillators against SpectralModeBank, slow modes, 1 s at 48 kHz in 256-sample blocks");
+        {
+            TestVoice::computeTables();
+            std::vector<double> sinTable(SIN_LUT_RESOLUTION);
+            for (size_t i = 0; i < sinTable.size(); i++)
+                sinTable[i] = std::sin(2.0 * M_PI * double(i) / SIN_LUT_RESOLUTION);
+
+            for (size_t numModes : { 64, 128, 256, 1024, 8000 })
+            {
+                double oscillatorMs = timeSlowModes(numModes, false, sinTable);
+                double spectralMs = timeSlowModes(numModes, true, sinTable);
+                logMessage(String(int(numModes)) + " modes: oscillators " + String(oscillatorMs, 1)
+                           + " ms, spectral " + String(spectralMs, 1) + " ms");
+            }
+        }
+
+        beginTest("Full rate against multirate, one voice, 1 s at 48 kHz in 256-sample blocks");
+        for (auto [dimensions, m] : { std::pair(2, 20), std::pair(3, 10), std::pair(3, 20) })
+        {
+            double fullRateMs = timeVoice(OscillatorEngine::lookupTable, dimensions, m, false);
+            double multirateMs = timeVoice(OscillatorEngine::lookupTable, dimensions, m, true);
+            logMessage(String(dimensions) + "D, " + String(m) + " modes per axis: full rate "
+                       + String(fullRateMs, 1) + " ms, multirate " + String(multirateMs, 1) + " ms");
+        }
+    }
+
+private:
+    static constexpr int numRuns = 5;  // the fastest one is reported
+    static constexpr int numSamples = 48000;
+    static constexpr int blockSize = 256;
+
+    static double timeKernel(ModeBank::InstructionSet instructionSet, const std::vector<double>& sinTable,
+                             std::vector<double>& output)
+    {
+        const size_t numModes = 400;
+        Random random(42);
+        std::vector<uint32_t> increments(numModes);
+        std::vector<double> gains(numModes), decays(numModes);
+        for (size_t i = 0; i < numModes; i++)
+        {
+            increments[i] = uint32_t(random.nextDouble() * 0x40000000);
+            gains[i] = 1.0 / double(numModes);
+            decays[i] = 1.0 - 1e-4 * random.nextDouble();
+        }
+        std::vector<double> scratch(ModeBank::getScratchSize(blockSize));
+
+        double best = 0;
+        for (int run = 0; run < numRuns; run++)
+        {
+            std::vector<uint32_t> phases(numModes, 0);
+            std::vector<double> envStates(numModes, 1.0);
+            output.assign(numSamples, 0.0);
+
+            double start = Time::getMillisecondCounterHiRes();
+            for (int s = 0; s < numSamples; s += blockSize)
+                ModeBank::render(instructionSet, sinTable.data(), SIN_LUT_SHIFT, phases.data(),
+                                 increments.data(), nullptr, nullptr, gains.data(), decays.data(),
+                                 envStates.data(), numModes, output.data() + s,
+                                 jmin(blockSize, numSamples - s), scratch.data());
+            double ms = Time::getMillisecondCounterHiRes() - start;
+            best = (run == 0 ? ms : jmin(best, ms));
+        }
+        return best;
+    }
+
+    // modes that SpectralModeBank::isSlowEnough() accepts, with their states advanced per block
+    // like SynthVoice does
+    static double timeSlowModes(size_t numModes, bool spectral, const std::vector<double>& sinTable)
+    {
+        Random random(42);
+        std::vector<uint32_t> increments(numModes);
+        std::vector<double> gains(numModes), decays(numModes);
+        for (size_t i = 0; i < numModes; i++)
+        {
+            increments[i] = uint32_t(random.nextDouble() * 0x40000000);
+            gains[i] = 1.0 / double(numModes);
+            decays[i] = 1.0 - 1e-4 * random.nextDouble();
+        }
+        std::vector<double> scratch(ModeBank::getScratchSize(blockSize)), output(numSamples);
+
+        double best = 0;
+        for (int run = 0; run < numRuns; run++)
+        {
+            SpectralModeBank spectralModes;
+            std::vector<uint32_t> phases(numModes, 0);
+            std::vector<double> envStates(numModes, 1.0);
+
+            double start = Time::getMillisecondCounterHiRes();
+            for (int s = 0; s < numSamples; s += blockSize)
+            {
+                int n = jmin(blockSize, numSamples - s);
+                if (spectral)
+                {
+                    spectralModes.render(sinTable.data(), SIN_LUT_SHIFT, phases.data(), increments.data(),
+                                         gains.data(), decays.data(), envStates.data(), numModes,
+                                         output.data() + s, n);
+                    for (size_t i = 0; i < numModes; i++)
+                    {
+                        phases[i] += increments[i] * uint32_t(n);
+                        envStates[i] *= ModeBank::integerPower(decays[i], n);
+                    }
+                }
+                else
+                {
+                    ModeBank::render(sinTable.data(), SIN_LUT_SHIFT, phases.data(), increments.data(),
+                                     nullptr, nullptr, gains.data(), decays.data(), envStates.data(),
+                                     numModes, output.data() + s, n, scratch.data());
+                }
+            }
+            double ms = Time::getMillisecondCounterHiRes() - start;
+            best = (run == 0 ? ms : jmin(best, ms));
+        }
+        return best;
+    }
+
+    static double timeVoice(OscillatorEngine engine, int dimensions, int m, bool multirate)
+    {
+        std::vector<double> output;
+        return timeVoice(engine, dimensions, m, multirate, output);
+    }
+
+    static double timeVoice(OscillatorEngine engine, int dimensions, int m, bool multirate,
+                            std::vector<double>& output)
+    {
+        PatchParams patch = TestVoice::makePatch(dimensions, m);
+
+        double best = 0;
+        for (int run = 0; run < numRuns; run++)
+        {
+            // rendered by the oscillators, whatever the defaults
+            SynthVoice voice;
+            voice.setOscillatorEngine(engine);
+            voice.setSpectralModeThreshold(0);
+            voice.setMultirate(multirate);
+
+            double start = Time::getMillisecondCounterHiRes();
+            output = TestVoice::render(voice, patch, 48, numSamples, blockSize);
+            double ms = Time::getMillisecondCounterHiRes() - start;
+            best = (run == 0 ? ms : jmin(best, ms));
+        }
+        return best;
+    }
+};
+
+static ModeBankBenchmark modeBankBenchmark;
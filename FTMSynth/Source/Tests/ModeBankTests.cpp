@@ -0,0 +1,313 @@
+/*
+  ==============================================================================
+
+    ModeBankTests.cpp
+    Created: 17 Oct 2026 12:58:50pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "../Processor/ModeBank.h"
+#include "TestVoice.h"
+
+
+class ModeBankTests : public UnitTest
+{
+public:
+    ModeBankTests() : UnitTest("ModeBank", "FTMSynth") {}
+
+    void runTest() override
+    {
+        beginTest("Increment ramps advance the phases by the exact fixed-point steps");
+        {
+            // 13 modes, so that the AVX2, SSE2 and scalar kernels all get some
+            const size_t numModes = 13;
+            std::vector<double> sinTable(tableSize, 0.0);
+            std::vector<double> gains(numModes, 1.0), decays(numModes, 1.0);
+
+            Random random = getRandom();
+            for (int numSamples : { 1, 7, 64, 256, 1000 })
+            {
+                std::vector<uint32_t> increments(numModes), stepFractions(numModes), expectedPhases(numModes);
+                std::vector<int32_t> steps(numModes);
+                for (size_t i = 0; i < numModes; i++)
+                {
+                    increments[i] = uint32_t(random.nextInt(0x40000000));
+                    int64_t step = int64_t((random.nextDouble() - 0.5) * 0x10000 * 4294967296.0);
+                    steps[i] = int32_t(step >> 32);
+                    stepFractions[i] = uint32_t(step);
+
+                    // increment of sample k: increments + (k * step + initialStepFraction) >> 32
+                    uint32_t phase = 0;
+                    for (int k = 0; k < numSamples; k++)
+                        phase += increments[i] + uint32_t((k * step + int64_t(ModeBank::initialStepFraction)) >> 32);
+                    expectedPhases[i] = phase;
+                }
+
+                for (int set = 0; set <= int(ModeBank::getInstructionSet()); set++)
+                {
+                    std::vector<uint32_t> phases(numModes, 0);
+                    std::vector<double> envStates(numModes, 1.0), output((size_t) numSamples, 0.0);
+                    std::vector<double> scratch(ModeBank::getScratchSize(numSamples));
+                    ModeBank::render(ModeBank::InstructionSet(set), sinTable.data(), tableShift,
+                                     phases.data(), increments.data(), steps.data(), stepFractions.data(),
+                                     gains.data(), decays.data(), envStates.data(), numModes,
+                                     output.data(), numSamples, scratch.data());
+
+                    expect(phases == expectedPhases, "instruction set " + String(set) + ", "
+                                                     + String(numSamples) + " samples");
+                }
+            }
+        }
+
+        beginTest("Vectorised kernels match the scalar ones on the sine tables");
+        {
+            TestVoice::computeTables();
+            Random random = getRandom();
+            for (int numSamples : { 1, 7, 256, 1000 })
+            {
+                expectKernelsAgree(Bank(random, numSamples, false));
+                expectKernelsAgree(Bank(random, numSamples, true));
+            }
+        }
+
+        beginTest("Oscillator engines stay close to the lookup-table kernel");
+        {
+            TestVoice::computeTables();
+            Random random = getRandom();
+            for (int numSamples : { 7, 256, 1000 })
+                expectEngineErrors(Bank(random, numSamples, false));
+        }
+    }
+
+private:
+    // the phases are what is checked, an all-zero table will do
+    static constexpr int tableShift = 14;
+    static constexpr int tableSize = 1 << (32 - tableShift);
+
+    // a block of random modes, 37 so that every kernel gets a remainder
+    struct Bank
+    {
+        static constexpr size_t numModes = 37;
+        int numSamples;
+        std::vector<uint32_t> phases, increments, stepFractions;
+        std::vector<int32_t> steps;
+        std::vector<double> gains, decays, envStates;
+        bool ramped;
+
+        Bank(Random& random, int samples, bool withRamps)
+            : numSamples(samples), phases(numModes), increments(numModes), stepFractions(numModes),
+              steps(numModes), gains(numModes), decays(numModes), envStates(numModes), ramped(withRamps)
+        {
+            for (size_t i = 0; i < numModes; i++)
+            {
+                phases[i] = uint32_t(random.nextInt());
+                increments[i] = uint32_t(random.nextInt(0x40000000));
+                int64_t step = int64_t((random.nextDouble() - 0.5) * 0x100 * 4294967296.0);
+                steps[i] = int32_t(step >> 32);
+                stepFractions[i] = uint32_t(step);
+                gains[i] = random.nextDouble() - 0.5;
+                decays[i] = 1.0 - 0.001 * random.nextDouble();
+                envStates[i] = 0.5 + 0.5 * random.nextDouble();
+            }
+        }
+
+        // bound of the output, which the errors are relative to
+        double getPeak() const
+        {
+            double peak = 0;
+            for (size_t i = 0; i < numModes; i++)
+                peak += std::abs(gains[i] * envStates[i]);
+            return peak;
+        }
+
+        String getName() const
+        {
+            return String(numSamples) + " samples" + (ramped ? ", ramped" : "");
+        }
+    };
+
+    // output, phases and envelopes of one kernel call
+    struct Result
+    {
+        std::vector<double> output;
+        std::vector<uint32_t> phases;
+        std::vector<double> envStates;
+    };
+
+    static Result renderTable(ModeBank::InstructionSet set, const Bank& bank)
+    {
+        Result result { std::vector<double>((size_t) bank.numSamples, 0.0), bank.phases, bank.envStates };
+        std::vector<double> scratch(ModeBank::getScratchSize(bank.numSamples));
+        ModeBank::render(set, SynthVoice::sinLUT, SIN_LUT_SHIFT, result.phases.data(), bank.increments.data(),
+                         bank.ramped ? bank.steps.data() : nullptr, bank.ramped ? bank.stepFractions.data() : nullptr,
+                         bank.gains.data(), bank.decays.data(), result.envStates.data(), Bank::numModes,
+                         result.output.data(), bank.numSamples, scratch.data());
+        return result;
+    }
+
+    static Result renderInterpolated(ModeBank::InstructionSet set, const Bank& bank)
+    {
+        Result result { std::vector<double>((size_t) bank.numSamples, 0.0), bank.phases, bank.envStates };
+        std::vector<double> scratch(ModeBank::getScratchSize(bank.numSamples));
+        ModeBank::renderInterpolated(set, SynthVoice::compactSinLUT, COMPACT_SIN_LUT_BITS,
+                                     result.phases.data(), bank.increments.data(), bank.gains.data(),
+                                     bank.decays.data(), result.envStates.data(), Bank::numModes,
+                                     result.output.data(), bank.numSamples, scratch.data());
+        return result;
+    }
+
+    // the phasors, as a Result with their real and imaginary parts in envStates
+    static Result renderPhasors(ModeBank::InstructionSet set, const Bank& bank)
+    {
+        const double phaseToRadians = 2.0 * M_PI / 4294967296.0;
+        std::vector<double> re(Bank::numModes), im(Bank::numModes), rotorRe(Bank::numModes), rotorIm(Bank::numModes);
+        for (size_t i = 0; i < Bank::numModes; i++)
+        {
+            re[i] = bank.envStates[i] * std::cos(bank.phases[i] * phaseToRadians);
+            im[i] = bank.envStates[i] * std::sin(bank.phases[i] * phaseToRadians);
+            rotorRe[i] = bank.decays[i] * std::cos(bank.increments[i] * phaseToRadians);
+            rotorIm[i] = bank.decays[i] * std::sin(bank.increments[i] * phaseToRadians);
+        }
+
+        Result result { std::vector<double>((size_t) bank.numSamples, 0.0), {}, re };
+        result.envStates.insert(result.envStates.end(), im.begin(), im.end());
+        std::vector<double> scratch(ModeBank::getScratchSize(bank.numSamples));
+        ModeBank::renderPhasors(set, result.envStates.data(), result.envStates.data() + Bank::numModes,
+                                rotorRe.data(), rotorIm.data(), bank.gains.data(), Bank::numModes,
+                                result.output.data(), bank.numSamples, scratch.data());
+        return result;
+    }
+
+    static Result renderFloat(ModeBank::InstructionSet set, const Bank& bank)
+    {
+        std::vector<float> gains(bank.gains.begin(), bank.gains.end());
+        std::vector<float> decays(bank.decays.begin(), bank.decays.end());
+        std::vector<float> envStates(bank.envStates.begin(), bank.envStates.end());
+        std::vector<float> output((size_t) bank.numSamples, 0.0f);
+        std::vector<float> scratch(ModeBank::getFloatScratchSize(bank.numSamples));
+
+        Result result { {}, bank.phases, {} };
+        ModeBank::renderFloat(set, SynthVoice::sinLUTf, SIN_LUT_SHIFT, result.phases.data(),
+                              bank.increments.data(), gains.data(), decays.data(), envStates.data(),
+                              Bank::numModes, output.data(), bank.numSamples, scratch.data());
+        result.output.assign(output.begin(), output.end());
+        result.envStates.assign(envStates.begin(), envStates.end());
+        return result;
+    }
+
+    static Result renderBlockExponential(const Bank& bank)
+    {
+        const int chunk = ModeBank::envelopeChunk;
+        std::vector<double> decayPowers(Bank::numModes * chunk), chunkDecays(Bank::numModes);
+        for (size_t i = 0; i < Bank::numModes; i++)
+        {
+            // as in SynthVoice::updateDecayPowers()
+            double power = 1.0;
+            for (int k = 0; k < chunk; k++)
+            {
+                decayPowers[i*chunk + k] = power;
+                power *= bank.decays[i];
+            }
+            chunkDecays[i] = power;
+        }
+
+        Result result { std::vector<double>((size_t) bank.numSamples, 0.0), bank.phases, bank.envStates };
+        ModeBank::renderBlockExponential(SynthVoice::sinLUT, SIN_LUT_SHIFT, result.phases.data(),
+                                         bank.increments.data(), bank.gains.data(), bank.decays.data(),
+                                         decayPowers.data(), chunkDecays.data(), result.envStates.data(),
+                                         Bank::numModes, result.output.data(), bank.numSamples);
+        return result;
+    }
+
+    // every instruction set against the scalar kernel: the same phases and envelopes, and the
+    // same output up to the order in which the modes are summed
+    void expectKernelsAgree(const Bank& bank)
+    {
+        using Kernel = Result (*)(ModeBank::InstructionSet, const Bank&);
+        struct { const char* name; Kernel kernel; double tolerance; } kernels[] = {
+            { "table", renderTable, 1e-14 },
+            { "interpolated", renderInterpolated, 1e-14 },
+            { "phasors", renderPhasors, 1e-14 },
+            { "float", renderFloat, 1e-6 }
+        };
+
+        for (auto& k : kernels)
+        {
+            // the ramps only exist in render()
+            if (bank.ramped && k.kernel != renderTable) continue;
+
+            Result reference = k.kernel(ModeBank::InstructionSet::scalar, bank);
+            for (int set = 1; set <= int(ModeBank::getInstructionSet()); set++)
+            {
+                Result result = k.kernel(ModeBank::InstructionSet(set), bank);
+                String name = String(k.name) + ", instruction set " + String(set) + ", " + bank.getName();
+                expect(result.phases == reference.phases, name + " phases");
+                expect(result.envStates == reference.envStates, name + " envelopes");
+                expectLessThan(TestVoice::getMaxDifference(result.output, reference.output),
+                               k.tolerance * bank.getPeak(), name);
+            }
+        }
+    }
+
+    // the other engines against the lookup-table kernel, whose truncated reads are off by up
+    // to 2pi / 2^18 = 2.4e-5. The interpolated table and the phasors are closer to sin()
+    // (about 1e-6 and 1e-13), so the differences are mostly the table's
+    void expectEngineErrors(const Bank& bank)
+    {
+        Result reference = renderTable(ModeBank::getInstructionSet(), bank);
+        double peak = bank.getPeak();
+
+        // about 6e-6 of the peak
+        Result interpolated = renderInterpolated(ModeBank::getInstructionSet(), bank);
+        expectLessThan(TestVoice::getMaxDifference(interpolated.output, reference.output), 3e-5 * peak,
+                       "interpolated table, " + bank.getName());
+        expect(interpolated.phases == reference.phases && interpolated.envStates == reference.envStates,
+               "interpolated table state, " + bank.getName());
+
+        // about 6e-6 of the peak
+        Result phasors = renderPhasors(ModeBank::getInstructionSet(), bank);
+        expectLessThan(TestVoice::getMaxDifference(phasors.output, reference.output), 3e-5 * peak,
+                       "phasors, " + bank.getName());
+        for (size_t i = 0; i < Bank::numModes; i++)
+        {
+            double re = phasors.envStates[i], im = phasors.envStates[i + Bank::numModes];
+            expectWithinAbsoluteError(std::sqrt(re*re + im*im), reference.envStates[i], 1e-12,
+                                      "phasor envelope, " + bank.getName());
+        }
+
+        // the same table reads, the envelopes only differ by rounding
+        Result blockExponential = renderBlockExponential(bank);
+        expectLessThan(TestVoice::getMaxDifference(blockExponential.output, reference.output), 1e-13 * peak,
+                       "block exponential, " + bank.getName());
+        expect(blockExponential.phases == reference.phases, "block exponential phases, " + bank.getName());
+        for (size_t i = 0; i < Bank::numModes; i++)
+            expectWithinAbsoluteError(blockExponential.envStates[i], reference.envStates[i], 1e-13,
+                                      "block exponential envelope, " + bank.getName());
+    }
+};
+
+static ModeBankTests modeBankTests;
@@ -0,0 +1,393 @@
+/*
+  ==============================================================================
+
+    SynthVoiceTests.cpp
+    Created: 17 Oct 2026 12:54:06pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <vector>
+#include "TestVoice.h"
+#include "../Processor/NoteTableCache.h"
+
+
+class SynthVoiceTests : public UnitTest
+{
+public:
+    SynthVoiceTests() : UnitTest("SynthVoice", "FTMSynth") {}
+
+    void runTest() override
+    {
+        beginTest("Single-precision modes stay close to the double ones over a 10 s decay");
+        {
+            // about 3.2e-6 (3D) and 1.8e-6 (2D) of the peak
+            expectFloatError(3, 12);
+            expectFloatError(2, 20);
+        }
+
+        beginTest("Spectral modes stay 70 dB below the peak of the oscillators");
+        {
+            // about -82 to -87 dB with Selesnick's algorithm, down to -72 dB with Rabenstein's
+            for (auto algorithm : { selesnick, rabenstein })
+                for (int midiNote : { 36, 60 })
+                {
+                    expectSpectralError(algorithm, midiNote, 2, 32);
+                    expectSpectralError(algorithm, midiNote, 3, 12);
+                }
+        }
+
+        beginTest("Voices don't render by inverse FFT by default");
+        {
+            PatchParams patch = TestVoice::makePatch(3, 20);
+            SynthVoice defaultVoice, oscillatorVoice;
+            oscillatorVoice.setSpectralModeThreshold(0);
+            expect(TestVoice::render(defaultVoice, patch, 48, 48000)
+                   == TestVoice::render(oscillatorVoice, patch, 48, 48000));
+        }
+
+        beginTest("Multirate modes stay 80 dB below the peak of the full-rate ones");
+        {
+            // about -88 to -96 dB with Selesnick's algorithm, down to -83 dB with Rabenstein's
+            for (auto algorithm : { selesnick, rabenstein })
+                for (int midiNote : { 36, 60 })
+                {
+                    expectMultirateError(algorithm, midiNote, 2, 20);
+                    expectMultirateError(algorithm, midiNote, 3, 20);
+                }
+        }
+
+        beginTest("Voices render every mode at the full rate by default");
+        {
+            PatchParams patch = TestVoice::makePatch(3, 20);
+            SynthVoice defaultVoice, fullRateVoice;
+            fullRateVoice.setMultirate(false);
+            expect(TestVoice::render(defaultVoice, patch, 36, 48000)
+                   == TestVoice::render(fullRateVoice, patch, 36, 48000));
+        }
+
+        beginTest("Selesnick excitation projection matches the direct trapezoid integration");
+        {
+            TestVoice::computeTables();
+            // the axis lengths of a 1D string, a 2D plate of default height and a thin 3D box
+            expectProjection(M_PI, 0.3, "1D");
+            expectProjection(0.5 * M_PI, 0.4, "2D");
+            expectProjection(0.01 * M_PI, 0.45, "3D");
+        }
+
+        beginTest("Sine sequences stay within 1e-13 of sin()");
+        {
+            // the per-axis angles of the excitation and pickup gains lie in [0, pi]
+            for (int count = 1; count <= std::max({ MAX_M1, MAX_M2, MAX_M3 }); count++)
+                for (int i = 0; i <= 64; i++)
+                    expectSineSequence(i * M_PI / 64, count);
+
+            // excitationSin
+            expectSineSequence(M_PI / SynthVoice::tau, 2 * SynthVoice::tau - 1);
+        }
+
+        beginTest("Incremental, prepared and cached mode tables match a full computation");
+        {
+            for (auto algorithm : { selesnick, rabenstein })
+            {
+                PatchParams base = TestVoice::makePatch(3, 12, algorithm);
+                String name = (algorithm == selesnick ? "Selesnick, " : "Rabenstein, ");
+
+                PatchParams changed = base;
+                changed.r1 = 0.6f;
+                changed.r2 = 0.25f;
+                changed.r3 = 0.7f;
+                expectCachedTables(base, changed, TestVoice::sampleRate, name + "excitation point");
+
+                changed = base;
+                changed.sustain = 0.5f;
+                changed.damp = 0.4f;
+                expectCachedTables(base, changed, TestVoice::sampleRate, name + "sustain and damp");
+
+                changed = base;
+                changed.dispersion = 0.3f;
+                expectCachedTables(base, changed, TestVoice::sampleRate, name + "dispersion");
+
+                expectCachedTables(base, base, 44100.0, name + "sample rate");
+
+                changed = base;
+                changed.algorithm = float(algorithm == selesnick ? rabenstein : selesnick);
+                expectCachedTables(base, changed, TestVoice::sampleRate, name + "algorithm");
+
+                changed = base;
+                changed.dimensions = 2.0f;
+                changed.m1 = 20.0f;
+                expectCachedTables(base, changed, TestVoice::sampleRate, name + "dimensions");
+            }
+        }
+
+        beginTest("Modes glided past Nyquist come back like on a fresh note");
+        {
+            for (auto algorithm : { selesnick, rabenstein })
+                expectNyquistRoundTrip(algorithm);
+        }
+    }
+
+private:
+    // largest difference between the double and float renderings of a 10 s note,
+    // with every mode kept so that the error of the quiet ones counts too
+    void expectFloatError(int dimensions, int m)
+    {
+        PatchParams patch = TestVoice::makePatch(dimensions, m);
+        const int numSamples = int(10 * TestVoice::sampleRate);
+
+        std::vector<double> outputs[2];
+        for (int singlePrecision = 0; singlePrecision < 2; singlePrecision++)
+        {
+            SynthVoice voice;
+            voice.setSinglePrecision(singlePrecision != 0);
+            voice.setSpectralModeThreshold(0);
+            voice.setMultirate(false);
+            voice.setModeCullThreshold(-1000.0);
+            outputs[singlePrecision] = TestVoice::render(voice, patch, 48, numSamples);
+        }
+
+        expectLessThan(TestVoice::getMaxDifference(outputs[1], outputs[0]),
+                       5e-6 * TestVoice::getPeak(outputs[0]),
+                       String(dimensions) + "D, " + String(m) + " modes per axis");
+    }
+
+    // difference between a note with its slow modes rendered by SpectralModeBank and
+    // the same note rendered by the oscillators only
+    void expectSpectralError(Algorithm algorithm, int midiNote, int dimensions, int m)
+    {
+        PatchParams patch = TestVoice::makePatch(dimensions, m, algorithm);
+        const int numSamples = int(2 * TestVoice::sampleRate);
+
+        std::vector<double> outputs[2];
+        for (int spectral = 0; spectral < 2; spectral++)
+        {
+            SynthVoice voice;
+            voice.setSpectralModeThreshold(spectral != 0 ? 256 : 0);
+            voice.setMultirate(false);
+            outputs[spectral] = TestVoice::render(voice, patch, midiNote, numSamples);
+        }
+
+        String name = String(algorithm == selesnick ? "Selesnick" : "Rabenstein") + ", note "
+                      + String(midiNote) + ", " + String(dimensions) + "D";
+        double difference = TestVoice::getMaxDifference(outputs[1], outputs[0]);
+        double peak = TestVoice::getPeak(outputs[0]);
+        expectGreaterThan(difference, 0.0, name + " uses the spectral bank");
+        expectLessThan(difference, Decibels::decibelsToGain(-70.0) * peak, name);
+    }
+
+    // difference between a note with its low modes rendered at decimated rates and
+    // the same note rendered at the full rate
+    void expectMultirateError(Algorithm algorithm, int midiNote, int dimensions, int m)
+    {
+        PatchParams patch = TestVoice::makePatch(dimensions, m, algorithm);
+        const int numSamples = int(2 * TestVoice::sampleRate);
+
+        std::vector<double> outputs[2];
+        for (int multirate = 0; multirate < 2; multirate++)
+        {
+            SynthVoice voice;
+            voice.setSpectralModeThreshold(0);
+            voice.setMultirate(multirate != 0);
+            outputs[multirate] = TestVoice::render(voice, patch, midiNote, numSamples);
+        }
+
+        String name = String(algorithm == selesnick ? "Selesnick" : "Rabenstein") + ", note "
+                      + String(midiNote) + ", " + String(dimensions) + "D";
+        double difference = TestVoice::getMaxDifference(outputs[1], outputs[0]);
+        double peak = TestVoice::getPeak(outputs[0]);
+        expectGreaterThan(difference, 0.0, name + " uses the low bands");
+        expectLessThan(difference, Decibels::decibelsToGain(-80.0) * peak, name);
+    }
+
+    // selesnick_project() against the trapezoid rule computed with sin(), for every mode of an
+    // axis of length l excited by the gaussian of selesnick_deff() centred at r*l
+    void expectProjection(double l, double r, const String& name)
+    {
+        const int tau = SynthVoice::tau;
+        const double s = 0.4;
+        const double h = l / tau;
+        double fx[tau + 1];
+        for (int i = 0; i <= tau; i++)
+            fx[i] = (1 / (s * sqrt(2*M_PI))) * exp(-0.5 * pow((i*h - l*r) / s, 2.0));
+
+        double f[MAX_M1];
+        SynthVoice::selesnick_project(fx, MAX_M1, f);
+
+        double maxError = 0;
+        for (int j = 0; j < MAX_M1; j++)
+        {
+            double integ = 0;
+            for (int i = 0; i < tau; i++)
+                integ += (fx[i+1]*sin((i+1)*h*M_PI*(j+1)/l) + fx[i]*sin(i*h*M_PI*(j+1)/l))*h/2.0;
+            double reference = 2*integ/l;
+            maxError = jmax(maxError, std::abs(f[j] - reference) / (1.0 + std::abs(reference)));
+        }
+        expectLessThan(maxError, 1e-12, name);
+    }
+
+    // starts a note of patch at sampleRate on voice, stopping the previous one
+    static void startNote(SynthVoice& voice, PatchParams patch, double sampleRate)
+    {
+        TestVoice::computeTables();
+
+        static SynthSound sound;
+        static int version = 1000;
+        patch.version = ++version;
+        voice.stopNote(0.0f, false);
+        if (voice.sr != sampleRate)  // which invalidates the tables, like in prepareToPlay()
+            voice.setCurrentPlaybackSampleRate(sampleRate);
+        voice.reserveModes(SynthVoice::getNumModes(int(patch.m1), int(patch.m2), int(patch.m3),
+                                                   int(patch.dimensions)));
+        voice.setPatchParams(patch);
+        voice.startNote(60, 0.8f, &sound, 8192);
+    }
+
+    // tables of a note of `changed` at sampleRate, on a voice that last played `base` at
+    // TestVoice::sampleRate (incremental recompute), from ModeTablePreparer's tables (computed
+    // like in its thread), and from the NoteTableCache entry another voice left, all against
+    // a voice computing everything
+    void expectCachedTables(const PatchParams& base, const PatchParams& changed, double sampleRate,
+                            const String& name)
+    {
+        SynthVoice fresh;
+        startNote(fresh, changed, sampleRate);
+
+        SynthVoice incremental;
+        startNote(incremental, base, TestVoice::sampleRate);
+        uint64_t computed = incremental.numStagesComputed;
+        startNote(incremental, changed, sampleRate);
+        expectSameTables(incremental, fresh, name + ", incremental");
+        if (base.algorithm == changed.algorithm && base.dimensions == changed.dimensions)
+            expectLessThan(incremental.numStagesComputed - computed, uint64_t(4), name + " skips some stages");
+
+        SynthVoice tableVoice, prepared;
+        ModeTable table;
+        PatchParams tablePatch = changed;
+        tablePatch.version = 1;
+        tableVoice.setPatchParams(tablePatch);
+        tableVoice.computeModeTable(tableVoice.getNextPatch(sampleRate), table);
+        startNote(prepared, base, TestVoice::sampleRate);
+        prepared.setModeTable(&table);
+        startNote(prepared, changed, sampleRate);
+        expectSameTables(prepared, fresh, name + ", prepared");
+
+        NoteTableCache cache;
+        cache.allocate(SynthVoice::getNumModes(int(changed.m1), int(changed.m2), int(changed.m3),
+                                               int(changed.dimensions)), size_t(1) << 20);
+        SynthVoice filling, cached;
+        filling.setNoteTableCache(&cache);
+        cached.setNoteTableCache(&cache);
+        startNote(filling, changed, sampleRate);
+        startNote(cached, base, TestVoice::sampleRate);
+        startNote(cached, changed, sampleRate);
+        expectSameTables(cached, fresh, name + ", cached");
+    }
+
+    void expectSameTables(const SynthVoice& voice, const SynthVoice& reference, const String& name)
+    {
+        int numModes = reference.getNumModes();
+        expectEquals(voice.getNumModes(), numModes, name + " modes");
+        if (voice.getNumModes() != numModes) return;
+
+        auto same = [numModes] (const auto& a, const auto& b)
+        {
+            return std::equal(a.begin(), a.begin() + numModes, b.begin());
+        };
+        bool rabenstein = (reference.currentAlgorithm == Algorithm::rabenstein);
+        expect(rabenstein ? same(voice.alpha, reference.alpha) : same(voice.sigma, reference.sigma),
+               name + " damping");
+        expect(same(voice.decayamp, reference.decayamp), name + " decayamp");
+        expect(same(voice.omega, reference.omega), name + " omega");
+        expect(same(voice.mode_rejected, reference.mode_rejected), name + " aliased modes");
+        expect(same(voice.knd, reference.knd), name + " knd");
+        if (rabenstein) expect(same(voice.yi, reference.yi), name + " yi");
+        expectEquals(voice.maxh, reference.maxh, name + " maxh");
+
+        expect(voice.activeModeIndex == reference.activeModeIndex, name + " active modes");
+        expect(voice.activeIncrements == reference.activeIncrements, name + " increments");
+        expect(voice.activeGains == reference.activeGains, name + " gains");
+        expect(voice.activeDecays == reference.activeDecays, name + " decays");
+    }
+
+    // raises the pitch of a sounding note until its upper modes pass Nyquist, brings it back,
+    // and compares the modes with those of the same note started at the original pitch
+    void expectNyquistRoundTrip(Algorithm algorithm)
+    {
+        PatchParams patch = TestVoice::makePatch(3, 20, algorithm);
+        patch.attack = 2.0f;
+        String name = (algorithm == selesnick ? "Selesnick" : "Rabenstein");
+
+        SynthVoice fresh, glided;
+        for (SynthVoice* voice : { &fresh, &glided })
+            voice->setModeCullThreshold(-1000.0);
+        TestVoice::render(fresh, patch, 72, 256);
+        TestVoice::render(glided, patch, 72, 256);
+
+        AudioBuffer<double> buffer(1, 256);
+        auto renderGlide = [&] (float pitch)
+        {
+            patch.pitch = pitch;
+            patch.version++;
+            glided.setPatchParams(patch);
+            for (int start = 0; start < 48000; start += 256)
+                glided.renderNextBlock(buffer, 0, 256);
+        };
+
+        renderGlide(24.0f);
+        expectGreaterThan(int(glided.numModesAtNyquist), 0, name + " reaches Nyquist");
+        expect(glided.attackDone, name + " leaves the attack path above Nyquist");
+
+        renderGlide(0.0f);
+        expectEquals(int(glided.numModesAtNyquist), 0, name);
+        expect(glided.activeModeIndex == fresh.activeModeIndex, name + " keeps every mode");
+
+        double maxIncrementError = 0, maxGainError = 0, maxDecayError = 0;
+        for (size_t i = 0; i < fresh.activeModeIndex.size(); i++)
+        {
+            maxIncrementError = jmax(maxIncrementError, std::abs(double(glided.activeIncrements[i])
+                                                                 - double(fresh.activeIncrements[i])));
+            maxGainError = jmax(maxGainError, std::abs(glided.activeGains[i] / fresh.activeGains[i] - 1));
+            maxDecayError = jmax(maxDecayError, std::abs(glided.activeDecays[i] - fresh.activeDecays[i]));
+        }
+        expectLessOrEqual(maxIncrementError, 2.0, name + " increments");
+        // the Rabenstein gains are rescaled by the rounded increments at every step of the glide
+        // (about 1.3e-7 after the round trip)
+        expectLessThan(maxGainError, 1e-6, name + " gains");
+        expectLessThan(maxDecayError, 1e-12, name + " decays");
+    }
+
+    void expectSineSequence(double theta, int count)
+    {
+        std::vector<double> output((size_t) count);
+        SynthVoice::getSineSequence(theta, count, output.data());
+
+        double maxError = 0;
+        for (int n = 0; n < count; n++)
+            maxError = jmax(maxError, std::abs(output[(size_t) n] - sin((n+1)*theta)));
+        expectLessThan(maxError, 1e-13, "theta " + String(theta) + ", " + String(count) + " terms");
+    }
+};
+
+static SynthVoiceTests synthVoiceTests;
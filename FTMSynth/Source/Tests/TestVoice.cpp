@@ -0,0 +1,118 @@
+/*
+  ==============================================================================
+
+    TestVoice.cpp
+    Created: 17 Oct 2026 12:50:25pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#include "TestVoice.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void TestVoice::computeTables()
+{
+    static bool computed = false;
+    if (computed) return;
+
+    SynthVoice::computeSinLUT();
+    SpectralModeBank::computeKernel();
+    BandUpsampler::computeFilter();
+    computed = true;
+}
+
+
+PatchParams TestVoice::makePatch(int dimensions, int m, Algorithm algorithm)
+{
+    PatchParams patch;
+    patch.algorithm = float(algorithm);
+    patch.volume = 0.75f;
+    patch.attack = 0.0f;
+    patch.pitch = 0.0f;
+    patch.kbTrack = 1.0f;
+    patch.sustain = 0.3f;
+    patch.susGate = 0.0f;
+    patch.release = 0.07f;
+    patch.damp = 0.1f;
+    patch.dampGate = 0.0f;
+    patch.ring = 0.0f;
+    patch.dispersion = 0.06f;
+    patch.alpha2d = 0.5f;
+    patch.alpha3d = 0.5f;
+    patch.r1 = 0.3f;
+    patch.r2 = 0.4f;
+    patch.r3 = 0.45f;
+    patch.m1 = float(m);
+    patch.m2 = float(m);
+    patch.m3 = float(m);
+    patch.dimensions = float(dimensions);
+    patch.version = 1;
+    return patch;
+}
+
+
+std::vector<double> TestVoice::render(SynthVoice& voice, const PatchParams& patch, int midiNote,
+                                      int numSamples, int blockSize)
+{
+    computeTables();
+
+    static SynthSound sound;
+    voice.setCurrentPlaybackSampleRate(sampleRate);
+    voice.reserveModes(SynthVoice::getNumModes(int(patch.m1), int(patch.m2), int(patch.m3),
+                                               int(patch.dimensions)));
+    voice.reserveBlockSize(blockSize);
+    voice.setPatchParams(patch);
+    voice.startNote(midiNote, 0.8f, &sound, 8192);
+
+    std::vector<double> output((size_t) numSamples);
+    AudioBuffer<double> buffer(1, blockSize);
+    for (int start = 0; start < numSamples; start += blockSize)
+    {
+        int n = jmin(blockSize, numSamples - start);
+        buffer.clear();
+        voice.renderNextBlock(buffer, 0, n);
+        std::copy(buffer.getReadPointer(0), buffer.getReadPointer(0) + n, output.begin() + start);
+    }
+    return output;
+}
+
+
+double TestVoice::getPeak(const std::vector<double>& signal)
+{
+    double peak = 0;
+    for (double x : signal)
+        peak = std::max(peak, std::abs(x));
+    return peak;
+}
+
+
+double TestVoice::getMaxDifference(const std::vector<double>& a, const std::vector<double>& b)
+{
+    jassert(a.size() == b.size());
+    double difference = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        difference = std::max(difference, std::abs(a[i] - b[i]));
+    return difference;
+}
@@ -0,0 +1,59 @@
+/*
+  ==============================================================================
+
+    TestVoice.h
+    Created: 17 Oct 2026 12:50:25pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+#pragma once
+
+#include <vector>
+#include <JuceHeader.h>
+#include "../Processor/SynthVoice.h"
+
+
+// Shared set-up of the unit tests and benchmarks: a single voice playing outside of a Synthesiser
+namespace TestVoice
+{
+    static constexpr double sampleRate = 48000.0;
+
+    // Computes the static tables the voices read from (only the first call does anything)
+    void computeTables();
+
+    // Default patch of the plugin, with m modes along each of the first `dimensions` axes and
+    // the impulse away from the nodes of the low modes
+    PatchParams makePatch(int dimensions, int m, Algorithm algorithm = selesnick);
+
+    // Plays midiNote with patch on a voice set up at sampleRate, for numSamples samples
+    // rendered in blocks of blockSize. The voice is expected to be configured already
+    // (engine, precision ...), the rest of its set-up is done here.
+    std::vector<double> render(SynthVoice& voice, const PatchParams& patch, int midiNote,
+                               int numSamples, int blockSize = 256);
+
+    // Largest absolute value of a signal
+    double getPeak(const std::vector<double>& signal);
+
+    // Largest absolute difference between two signals of the same length
+    double getMaxDifference(const std::vector<double>& a, const std::vector<double>& b);
+}
@@ -0,0 +1,124 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPoolBenchmark.cpp
+    Created: 17 Oct 2026 1:20:41pm
+    Author:  agent
+
+  ==============================================================================
+
+    This file is part of FTMSynth.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Affero General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Affero General Public License for more details.
+
+    You should have received a copy of the GNU Affero General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+  ==============================================================================
+*/
+
+
+
+#include <JuceHeader.h>
+#include <vector>
+#include "TestVoice.h"
+#include "../Processor/VoiceAllocator.h"
+#include "../Processor/VoiceRenderPool.h"
+
+
+// Timings of a full synth rendered by the audio thread alone and with VoiceRenderPool's workers.
+// Run with --benchmarks, on an otherwise idle machine with several cores.
+class VoiceRenderPoolBenchmark : public UnitTest
+{
+public:
+    VoiceRenderPoolBenchmark() : UnitTest("VoiceRenderPool", "Benchmarks") {}
+
+    void runTest() override
+    {
+        beginTest("MAX_VOICES 3D notes of 4 to 20 modes per axis, 1 s at 48 kHz in 256-sample blocks");
+        {
+            std::vector<float> serialOutput;
+            double serialMs = timeSynth(0, serialOutput);
+            logMessage("audio thread only: " + String(serialMs, 1) + " ms");
+
+            int maxWorkers = jmin(VoiceRenderPool::maxWorkers, SystemStats::getNumCpus() - 1);
+            if (maxWorkers < 1)
+                logMessage("single core, no worker to time");
+
+            for (int numWorkers = 1; numWorkers <= maxWorkers; numWorkers++)
+            {
+                std::vector<float> output;
+                double ms = timeSynth(numWorkers, output);
+                logMessage(String(numWorkers) + (numWorkers == 1 ? " worker: " : " workers: ") + String(ms, 1) + " ms ("
+                           + String(serialMs / ms, 2) + "x)");
+                expect(output == serialOutput, "the voices are added in the same order");
+            }
+        }
+    }
+
+private:
+    static constexpr int numRuns = 5;  // the fastest one is reported
+    static constexpr int numSamples = 48000;
+    static constexpr int blockSize = 256;
+
+    static double timeSynth(int numWorkers, std::vector<float>& output)
+    {
+        TestVoice::computeTables();
+
+        double best = 0;
+        for (int run = 0; run < numRuns; run++)
+        {
+            VoiceRenderPool pool;
+            VoiceAllocator allocator;
+            allocator.setNumVoices(MAX_VOICES);
+            StealingSynthesiser synth(allocator);
+            for (int i = 0; i < MAX_VOICES; i++)
+            {
+                // big and small notes, for the balancing between the threads
+                const int modesPerAxis[] = { 20, 12, 8, 4 };
+                PatchParams patch = TestVoice::makePatch(3, modesPerAxis[i % 4]);
+
+                SynthVoice* voice = new SynthVoice();
+                voice->setVoiceAllocator(&allocator, i);
+                voice->setCurrentPlaybackSampleRate(TestVoice::sampleRate);
+                voice->reserveModes(SynthVoice::getNumModes(int(patch.m1), int(patch.m2), int(patch.m3),
+                                                            int(patch.dimensions)));
+                voice->reserveBlockSize(blockSize);
+                voice->setPatchParams(patch);
+                synth.addVoice(voice);
+            }
+            synth.addSound(new SynthSound());
+
+            pool.prepare(numWorkers, blockSize, 1);
+            synth.setRenderPool(&pool);
+            for (int i = 0; i < MAX_VOICES; i++)
+                synth.noteOn(1, 36 + 2 * i, 0.8f);
+
+            AudioBuffer<float> buffer(1, blockSize);
+            MidiBuffer noMidi;
+            output.assign(numSamples, 0.0f);
+
+            double start = Time::getMillisecondCounterHiRes();
+            for (int s = 0; s < numSamples; s += blockSize)
+            {
+                int n = jmin(blockSize, numSamples - s);
+                buffer.clear();
+                synth.renderNextBlock(buffer, noMidi, 0, n);
+                std::copy(buffer.getReadPointer(0), buffer.getReadPointer(0) + n, output.begin() + s);
+            }
+            double ms = Time::getMillisecondCounterHiRes() - start;
+            best = (run == 0 ? ms : jmin(best, ms));
+        }
+        return best;
+    }
+};
+
+static VoiceRenderPoolBenchmark voiceRenderPoolBenchmark;